@@ -0,0 +1,103 @@
+#pragma once
+#include <Eigen/Dense>
+#include <cstdint>
+#include <vector>
+
+// Grid of bits, every row is packed into its own 64 bit words so rows can be
+// filled by different threads
+class BitGrid {
+public:
+  BitGrid(int rows, int cols)
+      : nRows(rows), nCols(cols), perRow((cols + 63) / 64),
+        words((size_t)rows * perRow, 0){};
+
+  int rows() const { return nRows; }
+  int cols() const { return nCols; }
+  int wordsPerRow() const { return perRow; }
+  const std::vector<uint64_t> &getWords() const { return words; }
+
+  void clear() { std::fill(words.begin(), words.end(), 0); }
+  uint64_t *row(int i) { return words.data() + (size_t)i * perRow; }
+  void set(int i, int j) {
+    row(i)[j / 64] |= uint64_t(1) << (j % 64);
+  }
+  bool get(int i, int j) const {
+    return (words[(size_t)i * perRow + j / 64] >> (j % 64)) & 1;
+  }
+
+  Eigen::ArrayXXd toArray() const {
+    Eigen::ArrayXXd grid(nRows, nCols);
+    for (int i = 0; i < nRows; i++) {
+      for (int j = 0; j < nCols; j++) {
+        grid(i, j) = get(i, j) ? 1.0 : 0.0;
+      }
+    }
+    return grid;
+  }
+
+private:
+  int nRows;
+  int nCols;
+  int perRow;
+  std::vector<uint64_t> words;
+};
+
+// Counts per cell how often its bit was set. The counts are kept in vertical
+// counters: bit p of every cell count lives in plane p of the word holding
+// the cell, so adding a grid is a ripple carry over a few words instead of a
+// pass over one double per cell. The planes are emptied into the totals
+// before they can overflow.
+class BitGridCounter {
+public:
+  BitGridCounter(int rows, int cols)
+      : perRow((cols + 63) / 64), planes((size_t)rows * perRow * nPlanes, 0),
+        totals(Eigen::ArrayXXd::Zero(rows, cols)){};
+
+  void add(const BitGrid &grid) {
+    const std::vector<uint64_t> &words = grid.getWords();
+    for (size_t k = 0; k < words.size(); k++) {
+      uint64_t *plane = planes.data() + k * nPlanes;
+      for (uint64_t carry = words[k], p = 0; carry; p++) {
+        uint64_t next = plane[p] & carry;
+        plane[p] ^= carry;
+        carry = next;
+      }
+    }
+    if (++pending == (1 << nPlanes) - 1) {
+      flush();
+    }
+  }
+
+  // Number of times every cell was set since construction or clear()
+  const Eigen::ArrayXXd &counts() {
+    flush();
+    return totals;
+  }
+
+  void clear() {
+    std::fill(planes.begin(), planes.end(), 0);
+    totals.setZero();
+    pending = 0;
+  }
+
+private:
+  static const int nPlanes = 8;
+  int perRow;
+  std::vector<uint64_t> planes;
+  Eigen::ArrayXXd totals;
+  int pending = 0;
+
+  void flush() {
+    for (size_t k = 0; k < planes.size() / nPlanes; k++) {
+      int i = k / perRow;
+      int jStart = (k % perRow) * 64;
+      for (int p = 0; p < nPlanes; p++) {
+        for (uint64_t bits = planes[k * nPlanes + p]; bits; bits &= bits - 1) {
+          totals(i, jStart + __builtin_ctzll(bits)) += (double)(1 << p);
+        }
+        planes[k * nPlanes + p] = 0;
+      }
+    }
+    pending = 0;
+  }
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <Eigen/Dense>
+#include <cmath>
+
+// Running mean and variance of the samples drawn for every cell of a grid
+class CellStatistics {
+public:
+  CellStatistics(int rows, int cols)
+      : sum(Eigen::ArrayXXd::Zero(rows, cols)),
+        sumSq(Eigen::ArrayXXd::Zero(rows, cols)),
+        count(Eigen::ArrayXXd::Zero(rows, cols)){};
+
+  void add(int i, int j, double value) {
+    sum(i, j) += value;
+    sumSq(i, j) += value * value;
+    count(i, j) += 1.0;
+  }
+
+  // Adds one sample for every cell
+  void add(const Eigen::ArrayXXd &values) {
+    sum += values;
+    sumSq += values.square();
+    count += 1.0;
+  }
+
+  // Adds samples that are 0 or 1 (lit or not) for every cell, given the
+  // number of lit samples per cell
+  void addLitCounts(const Eigen::ArrayXXd &lit, long samples) {
+    sum += lit;
+    sumSq += lit; // 1 * 1 = 1
+    count += (double)samples;
+  }
+
+  double mean(int i, int j) const {
+    return count(i, j) > 0.0 ? sum(i, j) / count(i, j) : 0.0;
+  }
+
+  // Half width of the 95% confidence interval on the mean
+  double halfWidth(int i, int j) const {
+    double n = count(i, j);
+    if (n < 2.0) {
+      return INFINITY;
+    }
+    double m = sum(i, j) / n;
+    double variance = std::max(0.0, (sumSq(i, j) - n * m * m) / (n - 1.0));
+    return 1.96 * std::sqrt(variance / n);
+  }
+
+  double samples(int i, int j) const { return count(i, j); }
+
+private:
+  Eigen::ArrayXXd sum;
+  Eigen::ArrayXXd sumSq;
+  Eigen::ArrayXXd count;
+};
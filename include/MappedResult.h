@@ -0,0 +1,54 @@
+#pragma once
+#include "ShadowResult.h"
+#include <Eigen/Dense>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <string>
+#include <vector>
+
+// A ShadowResult that lives in a memory mapped file (.gsr) instead of on the
+// heap, so results larger than the memory can be filled block by block. The
+// operating system pages the file in and out as needed.
+//
+// The file holds a header (magic, mode, grid size and the height and time of
+// every layer) followed by the layers in the column major layout of
+// ShadowResult. Values are stored in native byte order.
+class MappedResult {
+public:
+  // Creates (or overwrites) the file with zero filled layers, the
+  // constructors throw std::runtime_error if the file can not be mapped
+  MappedResult(std::string path, Mode mode, int rows, int cols,
+               const std::vector<ResultLayer> &layers);
+  // Opens an existing file
+  MappedResult(std::string path);
+
+  Mode getMode() const { return mode; }
+  int rows() const { return nRows; }
+  int cols() const { return nCols; }
+  size_t layerCount() const { return layers.size(); }
+  const std::vector<ResultLayer> &getLayers() const { return layers; }
+
+  Eigen::Map<const Eigen::ArrayXXd> layer(size_t i) const {
+    return Eigen::Map<const Eigen::ArrayXXd>(values + i * layerSize(), nRows,
+                                             nCols);
+  }
+  Eigen::Map<Eigen::ArrayXXd> layer(size_t i) {
+    return Eigen::Map<Eigen::ArrayXXd>(values + i * layerSize(), nRows,
+                                       nCols);
+  }
+
+  // Copies the layers of a result computed for the block of cells starting
+  // at cell (firstRow, firstCol), the layers have to match (throws
+  // std::invalid_argument otherwise)
+  void writeBlock(const ShadowResult &block, int firstRow, int firstCol);
+
+private:
+  boost::iostreams::mapped_file file;
+  Mode mode;
+  int nRows;
+  int nCols;
+  std::vector<ResultLayer> layers;
+  double *values = nullptr;
+
+  size_t layerSize() const { return (size_t)nRows * (size_t)nCols; }
+  static size_t headerSize(size_t nLayers);
+};
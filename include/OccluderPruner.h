@@ -0,0 +1,64 @@
+#pragma once
+#include "SimulationSetup.h"
+#include "WavefrontGeometry.h"
+#include <Eigen/Dense>
+#include <string>
+#include <vector>
+
+// Range of sun directions a run can sample. The azimuth is the angle of the
+// horizontal part of the direction in the geometry frame, atan2(y, x), and
+// covers the arc [azimuthStart, azimuthStart + azimuthWidth].
+struct SunEnvelope {
+  bool sunUp = false; // false if the sun never rises during the run
+  double azimuthStart = 0.0;
+  double azimuthWidth = 0.0;
+  double minAltitude = 0.0;
+  double maxAltitude = 0.0;
+};
+
+struct PruneReport {
+  size_t trianglesIn = 0;
+  size_t trianglesOut = 0;
+  size_t belowRegion = 0;
+  size_t behindRegion = 0; // for every sun direction of the run
+  size_t beyondReach = 0;  // too far away for the lowest sun of the run
+  size_t degenerate = 0;
+  size_t duplicate = 0;
+  size_t verticesIn = 0;
+  size_t verticesOut = 0; // after welding coincident vertices
+  size_t instancesIn = 0;
+  size_t instancesOut = 0;
+
+  std::string summary() const;
+};
+
+// Preprocessing pass between loading a scene and tracing it. Removes the
+// triangles (and instances) that can not shadow the region for any sun
+// direction of the run, degenerate and duplicate triangles, and welds
+// vertices with identical coordinates. All tests are conservative, the
+// traced result is the same as for the original scene.
+class OccluderPruner {
+public:
+  OccluderPruner(const Region &region, const SunEnvelope &envelope);
+
+  WavefrontGeometry prune(const WavefrontGeometry &scene,
+                          PruneReport &report) const;
+
+  // Envelope of the sun directions sampled by the given run (every minute of
+  // the dates the mode covers), padded by the radius of the sun disk
+  static SunEnvelope sunEnvelope(const Site &site, const RunSettings &settings);
+
+private:
+  enum class Verdict { keep, below, behind, beyondReach };
+
+  Region region;
+  SunEnvelope envelope;
+  std::vector<Eigen::Vector3d> regionCorners; // region prism up to maxHeight
+  Eigen::AlignedBox2d regionFootprint;
+  double regionMinZ;
+
+  // Classifies the convex hull of the points
+  Verdict classify(const std::vector<Eigen::Vector3d> &points) const;
+  // Largest value of d.v over the directions d in the envelope
+  double maxProjection(const Eigen::Vector3d &v) const;
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include "RayTests.h"
+#include "TriangleBvh.h"
+#include "WavefrontGeometry.h"
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <vector>
+
+// Flattened copy of the scene geometry prepared for tracing. Triangles are
+// stored with precomputed edges and grouped per object, every object has a
+// bounding box and the fraction of light it lets through. Instanced
+// prototypes are stored once in a TriangleBvh, rays are transformed into the
+// local frame of every instance they may hit.
+class OccluderSet {
+public:
+  OccluderSet(const WavefrontGeometry &scene);
+
+  // Fraction of the light that reaches rayOrigin from the given direction
+  double lightGoingThrough(const Eigen::Vector3d &rayOrigin,
+                           const Eigen::Vector3d &direction) const;
+
+  // Same for a packet of rays that share their origin and whose directions
+  // lie within coneAngle (radians) of axis. Object and instance bounds are
+  // tested once for the whole packet and the origin dependent part of every
+  // triangle test is shared by all rays.
+  void lightGoingThrough(const Eigen::Vector3d &rayOrigin,
+                         const std::vector<Eigen::Vector3d> &directions,
+                         const Eigen::Vector3d &axis, double coneAngle,
+                         double *light) const;
+
+  // Triangles in the scene, every instance counts fully
+  size_t triangleCount() const;
+  // True when no object lets light through, every ray then either reaches
+  // the sun or not
+  bool isOpaque() const { return opaque; }
+
+private:
+  struct Object {
+    double transmittance; // 1 - opacity
+    Eigen::AlignedBox3d bounds;
+    size_t first;
+    size_t last;
+  };
+  struct Instance {
+    size_t prototype;
+    Eigen::Affine3d toLocal;
+    Eigen::AlignedBox3d bounds; // in the scene frame
+  };
+  std::vector<Triangle> triangles;
+  std::vector<Object> occluders;
+  std::vector<TriangleBvh> prototypes;
+  std::vector<Instance> instances;
+  bool opaque = true;
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include "SimulationSetup.h"
+#include <boost/property_tree/ptree.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Translates the (xml) option file into the structs used by the calculator
+namespace optionreader {
+inline Eigen::Vector3d readVector(const boost::property_tree::ptree &options,
+                                  std::string key) {
+  std::stringstream vectorstream(options.get_child(key).data());
+  double x, y, z;
+  vectorstream >> x >> y >> z;
+  return Eigen::Vector3d(x, y, z);
+}
+
+inline Site readSite(const boost::property_tree::ptree &options) {
+  Site site;
+  site.latitude = options.get<double>("latitude");
+  site.longitude = options.get<double>("longitude");
+  site.timezone = options.get<double>("timezone");
+  site.geometryRotation = options.get<double>("geometryRotation");
+  return site;
+}
+
+inline Region readRegion(const boost::property_tree::ptree &options) {
+  Region region;
+  region.origin = readVector(options, "regionO");
+  region.vector1 = readVector(options, "regionV1");
+  region.vector2 = readVector(options, "regionV2");
+  region.stepsV1 = options.get<int>("stepsV1");
+  region.stepsV2 = options.get<int>("stepsV2");
+  region.maxHeight = options.get<double>("maxHeight");
+  region.heightIncr = options.get<double>("heightIncr");
+  return region;
+}
+
+// Names or materials of the receiver objects, empty to use the region
+inline std::vector<std::string>
+readReceivers(const boost::property_tree::ptree &options) {
+  std::stringstream namestream(options.get<std::string>("receivers", ""));
+  std::vector<std::string> names;
+  std::string name;
+  while (namestream >> name) {
+    names.push_back(name);
+  }
+  return names;
+}
+
+// Throws std::invalid_argument if the mode is unknown
+inline RunSettings readRunSettings(const boost::property_tree::ptree &options) {
+  RunSettings settings;
+  std::string mode = options.get<std::string>("mode");
+  if (!parseMode(mode, settings.mode)) {
+    throw std::invalid_argument(mode + " is not a valid mode.");
+  }
+  settings.date.year = options.get<int>("date.year");
+  settings.date.month = options.get<int>("date.month", 1);
+  settings.date.day = options.get<int>("date.day", 1);
+  settings.date.hour = options.get<int>("date.hour", 12);
+  settings.date.min = options.get<int>("date.minute", 0);
+  settings.nThreads = options.get<int>("nrOfThreads", 1);
+  settings.sunDiskSamples = options.get<int>("sunDiskSamples", 0);
+  settings.targetError = options.get<double>("targetError", 0.0);
+  settings.timeBudget = options.get<double>("timeBudget", 0.0);
+  settings.stochasticSampling = options.get<bool>("stochasticSampling", false);
+  return settings;
+}
+} // namespace optionreader
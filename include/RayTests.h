@@ -0,0 +1,122 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+
+// Triangle with precomputed edges, the layout used by the tracers
+struct Triangle {
+  Eigen::Vector3d v1;
+  Eigen::Vector3d edge1;
+  Eigen::Vector3d edge2;
+};
+
+namespace raytests {
+const double eps = 1e-6;
+
+// Moller-Trumbore, only hits in front of the ray origin count
+inline bool rayTriangleIntersect(const Eigen::Vector3d &rayOrigin,
+                                 const Eigen::Vector3d &direction,
+                                 const Triangle &tri) {
+  Eigen::Vector3d h = direction.cross(tri.edge2);
+  double a = tri.edge1.dot(h);
+
+  if (std::abs(a) < eps) {
+    return false;
+  }
+
+  double f = 1.0 / a;
+  Eigen::Vector3d s = rayOrigin - tri.v1;
+  double u = f * s.dot(h);
+
+  if (u < 0.0 || u > 1.0) {
+    return false;
+  }
+
+  Eigen::Vector3d q = s.cross(tri.edge1);
+  double v = f * direction.dot(q);
+
+  if ((v < 0.0) || (u + v) > 1.0) {
+    return false;
+  }
+
+  double t = f * tri.edge2.dot(q);
+  return t > eps;
+}
+
+// Moller-Trumbore rewritten with triple products for rays that share their
+// origin, everything that only depends on the triangle and the origin is
+// computed once. Lowers light[r] to transmittance for every ray that hits.
+inline void packetTriangleIntersect(const Eigen::Vector3d &rayOrigin,
+                                    const Eigen::Vector3d *directions,
+                                    size_t nRays, const Triangle &tri,
+                                    double transmittance, double *light) {
+  Eigen::Vector3d s = rayOrigin - tri.v1;
+  Eigen::Vector3d q = s.cross(tri.edge1);
+  Eigen::Vector3d w = tri.edge2.cross(s);
+  Eigen::Vector3d n = tri.edge2.cross(tri.edge1);
+  double e2q = tri.edge2.dot(q);
+
+  for (size_t r = 0; r < nRays; r++) {
+    if (light[r] <= transmittance) {
+      continue;
+    }
+    const Eigen::Vector3d &d = directions[r];
+    double a = d.dot(n);
+    if (std::abs(a) < eps) {
+      continue;
+    }
+    double f = 1.0 / a;
+    double u = f * d.dot(w);
+    if (u < 0.0 || u > 1.0) {
+      continue;
+    }
+    double v = f * d.dot(q);
+    if (v < 0.0 || u + v > 1.0) {
+      continue;
+    }
+    if (f * e2q > eps) {
+      light[r] = transmittance;
+    }
+  }
+}
+
+// Slab test for a ray that starts at rayOrigin and has no end
+inline bool rayHitsBox(const Eigen::Vector3d &rayOrigin,
+                       const Eigen::Vector3d &direction,
+                       const Eigen::AlignedBox3d &box) {
+  double tmin = 0.0;
+  double tmax = INFINITY;
+  for (int k = 0; k < 3; k++) {
+    if (std::abs(direction[k]) < 1e-12) {
+      if (rayOrigin[k] < box.min()[k] || rayOrigin[k] > box.max()[k]) {
+        return false;
+      }
+      continue;
+    }
+    double t1 = (box.min()[k] - rayOrigin[k]) / direction[k];
+    double t2 = (box.max()[k] - rayOrigin[k]) / direction[k];
+    tmin = std::max(tmin, std::min(t1, t2));
+    tmax = std::min(tmax, std::max(t1, t2));
+    if (tmin > tmax) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Conservative test of a cone (apex, unit axis, half angle) against the
+// bounding sphere of the box
+inline bool coneHitsBox(const Eigen::Vector3d &apex,
+                        const Eigen::Vector3d &axis, double coneAngle,
+                        const Eigen::AlignedBox3d &box) {
+  Eigen::Vector3d toCenter = box.center() - apex;
+  double distance = toCenter.norm();
+  double radius = 0.5 * box.diagonal().norm();
+  if (distance <= radius) {
+    return true;
+  }
+  double angle =
+      std::acos(std::clamp(axis.dot(toCenter) / distance, -1.0, 1.0));
+  return angle <= coneAngle + std::asin(radius / distance);
+}
+} // namespace raytests
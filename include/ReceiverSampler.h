@@ -0,0 +1,59 @@
+#pragma once
+#include "SimulationSetup.h"
+#include "WavefrontGeometry.h"
+#include <Eigen/Dense>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A point on the surface of a receiver object, the sun exposure is computed
+// for the side of the face the normal points to
+struct ReceiverPoint {
+  Eigen::Vector3d position;
+  Eigen::Vector3d normal; // unit normal, counterclockwise winding
+  size_t object;          // index in the objects of the scene
+  // triangle of the scene, counted from 0 over all objects in file order (a
+  // quad in the .obj file is two triangles)
+  size_t face;
+};
+
+// Generates sample points on the faces of receiver objects, so the sun
+// exposure can be computed on walls, roofs or planters instead of on a
+// rectangular region. Points are spread evenly over every face at about the
+// given density and sorted along a Morton (Z-order) curve, points that are
+// close in the list are close in space so neighbouring rays traverse the same
+// part of the scene.
+class ReceiverSampler {
+public:
+  // Objects are receivers if their name, the part of the name before the
+  // first '_' (Blender appends the mesh name) or their material is one of
+  // names. density in points per m2. Objects of prototypes are skipped.
+  // flipNormals turns all normals around, for receivers modelled from the
+  // other side (e.g. the inside of a box). Throws std::invalid_argument if
+  // the density is not positive.
+  ReceiverSampler(const WavefrontGeometry &scene,
+                  const std::vector<std::string> &names, double density,
+                  bool flipNormals = false);
+
+  const std::vector<ReceiverPoint> &getPoints() const { return points; }
+  const std::string &objectName(size_t object) const {
+    return objectNames[object];
+  }
+  size_t getReceiverFaces() const { return receiverFaces; }
+
+  // Axis aligned box around the points with one cell per point (stepsV1 is
+  // the number of points), for pruning and sizing the result grids
+  Region boundingRegion() const;
+
+private:
+  std::vector<ReceiverPoint> points;
+  std::vector<std::string> objectNames;
+  size_t receiverFaces = 0;
+  bool flipNormals;
+
+  void sampleFace(const Eigen::Vector3d &v1, const Eigen::Vector3d &v2,
+                  const Eigen::Vector3d &v3, int n, size_t object,
+                  size_t face);
+  void sortMorton();
+  static uint64_t mortonCode(uint64_t x, uint64_t y, uint64_t z);
+};
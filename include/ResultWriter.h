@@ -0,0 +1,45 @@
+#pragma once
+#include "MappedResult.h"
+#include "ReceiverSampler.h"
+#include "ShadowResult.h"
+#include <Eigen/Dense>
+#include <string>
+#include <vector>
+
+// Writes a ShadowResult as text files, one file per layer, in a mode specific
+// subdirectory of the output path. Throws std::runtime_error if a directory
+// or file can not be created.
+class ResultWriter {
+public:
+  ResultWriter(std::string outputPath) : outputPath(outputPath){};
+
+  // prefix is prepended to the file names, e.g. to keep error grids apart
+  void write(const ShadowResult &result, std::string prefix = "");
+  // Same for a result in a file, written layer by layer from the mapping
+  void write(const MappedResult &result, std::string prefix = "");
+  // Writes a result computed for receiver points (see
+  // ShadowCalculator::setReceivers) to receivers.txt, one line per point with
+  // its object, face, position and normal followed by a column per layer
+  void writeReceivers(const ShadowResult &result,
+                      const ReceiverSampler &receivers,
+                      std::string prefix = "");
+  // Overwrites the estimate and error grids and appends to convergence.txt
+  void writeProgressiveUpdate(const ProgressiveUpdate &update);
+  // Writes the error grids of a sampled average and sampling.txt with the
+  // period, samples and largest error per layer
+  void writeSamplingSummary(const ShadowResult &error,
+                            const std::vector<SamplingSummary> &summary);
+  // Path of a file (e.g. shadow masks, see ShadowMaskStore.h) in the
+  // directory of a mode, creates the directories it is in
+  std::string modeFilePath(Mode mode, std::string fileName);
+
+private:
+  std::string outputPath;
+
+  template <typename Result>
+  void writeLayers(const Result &result, std::string prefix);
+  std::string layerFileName(Mode mode, const ResultLayer &layer);
+  void checkForDirectory(std::string path);
+  void writeEigenArray2DToFile(const Eigen::Ref<const Eigen::ArrayXXd> &arr,
+                               std::string filename);
+};
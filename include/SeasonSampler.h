@@ -0,0 +1,59 @@
+#pragma once
+#include "tm_r.h"
+
+// Quasi random time stamps spread over a range of whole months. The Halton
+// sequence (bases 2 and 3) picks the day and the minute of the day, so any
+// prefix of the sequence covers both the season and the day evenly. This
+// makes it suited for estimates that are refined by drawing more samples.
+class SeasonSampler {
+public:
+  SeasonSampler(int year, int firstMonth, int lastMonth)
+      : year(year), firstMonth(firstMonth), lastMonth(lastMonth) {
+    for (int month = firstMonth; month <= lastMonth; month++) {
+      days += daysInMonth(year, month);
+    }
+  };
+
+  int getDays() const { return days; }
+
+  tm_r sample(long index) const {
+    // index + 1 skips the (0, 0) point of the sequence
+    int day = (int)(radicalInverse(index + 1, 2) * days);
+    int minute = (int)(radicalInverse(index + 1, 3) * 24 * 60);
+
+    tm_r tm;
+    tm.year = year;
+    tm.month = firstMonth;
+    while (day >= daysInMonth(year, tm.month) && tm.month < lastMonth) {
+      day -= daysInMonth(year, tm.month);
+      tm.month++;
+    }
+    tm.day = day + 1;
+    tm.hour = minute / 60;
+    tm.min = minute % 60;
+    return tm;
+  }
+
+  static int daysInMonth(int year, int month) {
+    const int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return (month == 2 && leap) ? 29 : days[month - 1];
+  }
+
+private:
+  int year;
+  int firstMonth;
+  int lastMonth;
+  int days = 0;
+
+  static double radicalInverse(long index, int base) {
+    double inverse = 0.0;
+    double digitValue = 1.0 / base;
+    while (index > 0) {
+      inverse += (index % base) * digitValue;
+      index /= base;
+      digitValue /= base;
+    }
+    return inverse;
+  }
+};
@@ -1,42 +1,147 @@
 #pragma once
+#include "BitGrid.h"
+#include "OccluderSet.h"
+#include "ReceiverSampler.h"
+#include "ShadowResult.h"
+#include "SimulationSetup.h"
 #include "SunTracker.h"
 #include "WavefrontGeometry.h"
 #include "tm_r.h"
 #include <Eigen/Dense>
-#include <boost/property_tree/ptree.hpp>
+#include <functional>
 #include <string>
 #include <vector>
 
 class ShadowCalculator {
 public:
-  ShadowCalculator(const std::vector<WavefrontObject> &objects, const std::vector<Eigen::Vector3d> &vertices, SunTracker &sun, boost::property_tree::ptree &options);
+  ShadowCalculator(const WavefrontGeometry &scene, const Site &site,
+                   const Region &region);
+
+  // Runs the mode given in the settings
+  ShadowResult run(const RunSettings &settings);
+
   Eigen::ArrayXXd computeShadow(tm_r tm, double height);
-  void growSeasonAverage();
-  void monthly();
-  void specificMoment();
-  void hourly();
+  ShadowResult growSeasonAverage(int year);
+  ShadowResult monthly(int year);
+  ShadowResult specificMoment(tm_r tm);
+  ShadowResult hourly(tm_r date);
+  // Growseason average that is refined in passes, see ProgressiveUpdate
+  ShadowResult progressive(int year, double targetError, double timeBudget);
+  // Growseason (one layer per height) or monthly average from quasi random
+  // time stamps over the whole months, drawn until the 95% confidence half
+  // width of every cell is below targetError (hours) or the sample density
+  // of the fixed steps is reached
+  ShadowResult sampledAverage(Mode mode, int year, double targetError);
 
+  // Restricts the calculation to the nV1 x nV2 cells of the region starting
+  // at cell (firstV1, firstV2), results then only cover those cells. Throws
+  // std::invalid_argument if the window is not inside the region.
+  void setWindow(int firstV1, int firstV2, int nV1, int nV2);
+  // Computes the exposure of the points instead of the cells of the region,
+  // point p is cell (p, 0) and there is a single height (0). Points get no
+  // sun from the directions (over the sun disk) behind their face. Throws
+  // std::invalid_argument without points.
+  void setReceivers(const std::vector<ReceiverPoint> &points);
+  void setNumberOfThreads(int n) { nThreads = n; }
+  void setShowProgress(bool show) { showProgress = show; }
+  // Number of rays cast over the sun disk per cell, rounded with sunDiskRays
+  // (below 3 the sun is a point)
+  void setSunDiskSamples(int n);
+  // Per cell, the fraction of the samples with the sun above the horizon in
+  // which the sun disk was partially blocked. Only filled with an area sun.
+  const ShadowResult &getPenumbraFraction() const { return penumbra; }
+  // Confidence half widths and summary per layer of the last sampledAverage
+  const ShadowResult &getSamplingError() const { return samplingError; }
+  const std::vector<SamplingSummary> &getSamplingSummary() const {
+    return samplingSummary;
+  }
+  void setUpdateCallback(std::function<void(const ProgressiveUpdate &)> f) {
+    onUpdate = f;
+  }
+  // Called with the light on the grid for every time sample traced by
+  // computeShadow, e.g. to record shadow masks (see ShadowMaskStore.h)
+  void setSampleCallback(
+      std::function<void(const tm_r &, double, const Eigen::ArrayXXd &)> f) {
+    onSample = f;
+  }
+  // Called instead of the sample callback on the binary path (opaque scene,
+  // point sun) with the lit cells as bits, so they are not expanded to doubles
+  void setVisibilityCallback(
+      std::function<void(const tm_r &, double, const BitGrid &)> f) {
+    onVisibility = f;
+  }
 
+  // Number of rays cast since construction (or the last reset), used for
+  // throughput measurements
+  long long getRaysTraced() const { return raysTraced; }
+  void resetRaysTraced() { raysTraced = 0; }
 
 private:
   Eigen::Vector3d origin;
   Eigen::Vector3d vector1;
   Eigen::Vector3d vector2;
   Eigen::Vector3d sunDir;
-  Eigen::Vector3d ray_origin;
   Eigen::Vector3d z_axis{0.0, 0.0, 1.0};
-  int stepsV1;
+  int stepsV1; // cells in the results, the window when one is set
   int stepsV2;
-  int nThreads;
+  int cellsV1; // cells in the whole region
+  int cellsV2;
+  int firstV1 = 0;
+  int firstV2 = 0;
+  double maxHeight;
+  double increment;
+  int nThreads = 1;
+  bool showProgress = false;
+  long long raysTraced = 0;
+  std::vector<ReceiverPoint> receivers;
+  std::function<void(const ProgressiveUpdate &)> onUpdate;
+  std::function<void(const tm_r &, double, const Eigen::ArrayXXd &)> onSample;
+  std::function<void(const tm_r &, double, const BitGrid &)> onVisibility;
   SunTracker sun;
-  boost::property_tree::ptree options;
-  const std::vector<WavefrontObject> &objects;
-  const std::vector<Eigen::Vector3d> &vertices;
-
-  bool ray_triangle_intersect(Eigen::Vector3d ray_origin,
-                            Eigen::Vector3d ray_direction, Eigen::Vector3d v1,
-                            Eigen::Vector3d v2, Eigen::Vector3d v3); 
-  void checkForDirectory(std::string path);
-  void writeEigenArray2DToFile(Eigen::ArrayXXd arr, std::string filename);
+  OccluderSet occluders;
+
+  // area sun, directions over the sun disk for the current sun position
+  int diskSamples = 0;
+  std::vector<Eigen::Vector3d> diskOffsets; // in units of the disk radius
+  std::vector<Eigen::Vector3d> diskDirections;
+  ShadowResult penumbra;
+  ShadowResult samplingError;
+  std::vector<SamplingSummary> samplingSummary;
+  std::vector<int> penumbraSamples;
+  Eigen::ArrayXXd penumbraSample;
+  bool sunUp = false;
+
+  // Opaque scenes with a point sun only need one bit per ray, the averaging
+  // modes then count the lit samples instead of summing grids of doubles
+  BitGrid visible;
+  bool binaryVisibility() const {
+    return diskSamples == 0 && occluders.isOpaque();
+  }
+  // Fills visible for the given moment, false if the sun is down
+  bool computeVisibility(tm_r tm, double height);
+  // Adds one time sample to cumSum, through counter on the binary path
+  void addSample(tm_r tm, double height, Eigen::Map<Eigen::ArrayXXd> &cumSum,
+                 BitGridCounter &counter);
+  // Moves the lit counts of the binary path into cumSum
+  void addCounts(Eigen::Map<Eigen::ArrayXXd> &cumSum, BitGridCounter &counter);
+
+  // Heights of the layers: from 0 in steps of increment up to maxHeight, or
+  // only below it (hourly and specific moment). Receivers have one height.
+  std::vector<double> layerHeights(bool belowMax) const;
+  Eigen::Vector3d cellOrigin(int i, int j, double height) const;
+  void setSunDirection(const Eigen::Vector3d &direction);
+  // Light reaching rayOrigin from the sun, averaged over the sun disk for an
+  // area sun. partial is set when only part of the disk is blocked. With a
+  // normal, the directions behind the face get no light.
+  double sunLight(const Eigen::Vector3d &rayOrigin, bool &partial,
+                  const Eigen::Vector3d *normal = nullptr) const;
+  // sunLight for a cell or receiver point
+  double cellLight(int i, int j, double height, bool &partial) const;
+
+  // Adds a layer to the result and, with an area sun, to the penumbra grids
+  size_t addLayer(ShadowResult &result, double height, tm_r tm);
+  void resetPenumbra(Mode mode);
+  void addPenumbraSample(size_t layer);
+  void finishPenumbra();
   void progressBar(double partDone);
-};
\ No newline at end of file
+};
@@ -0,0 +1,136 @@
+#pragma once
+#include "BitGrid.h"
+#include "tm_r.h"
+#include <Eigen/Dense>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Lit/shaded state of every cell at one time sample, one bit per cell in the
+// column major order of the result grids
+struct ShadowMask {
+  int rows = 0;
+  int cols = 0;
+  std::vector<uint64_t> words;
+
+  bool lit(int i, int j) const {
+    size_t k = (size_t)j * rows + i;
+    return (words[k / 64] >> (k % 64)) & 1;
+  }
+};
+
+// Binary time series of shadow masks (.gsm), written while a run traces and
+// read back without tracing again.
+//
+// The file starts with a header (magic, grid size, minutes per sample and the
+// lit threshold) followed by chunks. A chunk holds the samples of one height
+// on one day in time order: the minute of the day of every sample (varint
+// increments) and the masks, each stored as the XOR with the previous mask of
+// the chunk and run length encoded (varint count of zero words followed by
+// one literal word), so masks that hardly change between samples take a few
+// bytes. An index
+// with the height, date and offset of every chunk is written at the end,
+// followed by its own offset. Values are stored in native byte order.
+
+class ShadowMaskWriter {
+public:
+  // A cell is lit when the light reaching it is at least threshold.
+  // sampleMinutes is the time every sample stands for in aggregates. Throws
+  // std::runtime_error if the file can not be created.
+  ShadowMaskWriter(std::string path, int rows, int cols, int sampleMinutes,
+                   double threshold = 0.5);
+  ~ShadowMaskWriter();
+
+  // Samples of a height on a day have to be recorded in time order
+  void record(const tm_r &tm, double height, const Eigen::ArrayXXd &light);
+  // Same for the lit cells of the binary path of the calculator, the bits
+  // are taken as they are
+  void record(const tm_r &tm, double height, const BitGrid &lit);
+  // Writes the last chunk and the index, called by the destructor
+  void close();
+
+private:
+  struct Chunk {
+    double height;
+    tm_r date;
+    std::vector<uint16_t> minutes;
+    std::vector<uint8_t> payload;
+  };
+  struct IndexEntry {
+    double height;
+    int32_t year, month, day;
+    uint32_t samples;
+    uint64_t offset;
+  };
+
+  std::ofstream out;
+  int rows;
+  int cols;
+  double threshold;
+  bool open = false;
+  Chunk chunk;
+  std::vector<uint64_t> previous; // last mask of the current chunk
+  std::vector<uint64_t> current;
+  std::vector<IndexEntry> index;
+
+  // Starts a sample in the current chunk (or a new one) with an empty mask
+  void beginSample(const tm_r &tm, double height);
+  // Appends the mask in current to the chunk
+  void encodeSample();
+  void flush();
+};
+
+class ShadowMaskReader {
+public:
+  // Throws std::runtime_error for files that are not shadow mask files or
+  // damaged, reading the masks later does the same
+  ShadowMaskReader(std::string path);
+
+  int rows() const { return nRows; }
+  int cols() const { return nCols; }
+  int sampleMinutes() const { return minutesPerSample; }
+  double threshold() const { return litThreshold; }
+  // Heights with recorded masks, ascending, the height arguments below are
+  // indices into this list
+  const std::vector<double> &heights() const { return heightList; }
+  size_t chunkCount() const { return index.size(); }
+
+  // Calls f for every recorded mask of the height between the dates
+  // (inclusive, only year, month and day are used) in time order
+  void forEachMask(size_t height, const tm_r &from, const tm_r &to,
+                   const std::function<void(const tm_r &, const ShadowMask &)>
+                       &f) const;
+
+  // Hours every cell was lit between the dates, counting only samples with
+  // a time of day in [fromHour, toHour)
+  Eigen::ArrayXXd litHours(size_t height, const tm_r &from, const tm_r &to,
+                           int fromHour = 0, int toHour = 24) const;
+  // Lit hours on a single day
+  Eigen::ArrayXXd dailyTotal(size_t height, const tm_r &date) const;
+  // Lit hours divided by the number of days with samples, e.g. the average
+  // over a month or the growseason as written by those modes
+  Eigen::ArrayXXd averageDailyHours(size_t height, const tm_r &from,
+                                    const tm_r &to, int fromHour = 0,
+                                    int toHour = 24) const;
+
+private:
+  struct IndexEntry {
+    size_t height;
+    tm_r date;
+    uint32_t samples;
+    uint64_t offset;
+  };
+
+  std::string path;
+  int nRows;
+  int nCols;
+  int minutesPerSample;
+  double litThreshold;
+  std::vector<double> heightList;
+  std::vector<IndexEntry> index;
+
+  std::vector<const IndexEntry *> chunksBetween(size_t height, const tm_r &from,
+                                                const tm_r &to) const;
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include "SimulationSetup.h"
+#include "tm_r.h"
+#include <Eigen/Dense>
+#include <vector>
+
+// Describes what a single grid in a ShadowResult represents. Depending on the
+// mode only part of the time stamp is meaningful (e.g. only the month for
+// monthly results).
+struct ResultLayer {
+  double height;
+  tm_r time;
+};
+
+// Owns the output of a calculation. All grids (layers) are stored back to back
+// in one contiguous column major buffer, layer(i) gives a view into that
+// buffer without copying.
+class ShadowResult {
+public:
+  ShadowResult(Mode mode, int rows, int cols)
+      : mode(mode), nRows(rows), nCols(cols){};
+
+  Mode getMode() const { return mode; }
+  int rows() const { return nRows; }
+  int cols() const { return nCols; }
+  size_t layerCount() const { return layers.size(); }
+  const std::vector<ResultLayer> &getLayers() const { return layers; }
+
+  // Appends a zero initialized grid and returns its index
+  size_t addLayer(double height, tm_r time) {
+    layers.push_back({height, time});
+    buffer.resize(buffer.size() + layerSize(), 0.0);
+    return layers.size() - 1;
+  }
+
+  // Views stay valid until the next call to addLayer
+  Eigen::Map<const Eigen::ArrayXXd> layer(size_t i) const {
+    return Eigen::Map<const Eigen::ArrayXXd>(buffer.data() + i * layerSize(),
+                                             nRows, nCols);
+  }
+  Eigen::Map<Eigen::ArrayXXd> layer(size_t i) {
+    return Eigen::Map<Eigen::ArrayXXd>(buffer.data() + i * layerSize(), nRows,
+                                       nCols);
+  }
+
+  // Raw access to all layers, layer i starts at data() + i * rows() * cols()
+  const double *data() const { return buffer.data(); }
+  size_t size() const { return buffer.size(); }
+
+private:
+  Mode mode;
+  int nRows;
+  int nCols;
+  std::vector<ResultLayer> layers;
+  std::vector<double> buffer;
+
+  size_t layerSize() const { return (size_t)nRows * (size_t)nCols; }
+};
+
+// Intermediate result of the progressive mode, passed to the update callback
+// after every refinement pass
+struct ProgressiveUpdate {
+  int pass;
+  int stride;       // cells between traced points, 1 is the full resolution
+  long samples;     // time samples drawn so far
+  double maxError;  // largest 95% confidence half width of the traced cells (h)
+  double elapsed;   // seconds since the start of the run
+  bool converged;   // maxError is below the target on the full grid
+  bool final;       // no more passes will follow
+  const ShadowResult &estimate; // average daily sun hours
+  const ShadowResult &error;    // 95% confidence half width per cell (h)
+};
+
+// Outcome of the sampled (stochastic) averaging of one layer
+struct SamplingSummary {
+  size_t layer;
+  long samples;    // time samples drawn for the layer
+  double maxError; // largest 95% confidence half width of its cells (h)
+  bool converged;  // maxError reached the target before the sample limit
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include "tm_r.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+// Plain descriptions of a calculation, these are what the library takes as
+// input. The CLI fills them from the option file (see OptionReader.h).
+
+// Where on earth the scene is and how it is oriented
+struct Site {
+  double latitude = 0.0;
+  double longitude = 0.0;
+  double timezone = 0.0;
+  double geometryRotation = 0.0; // counterclockwise rotation w.r.t. north (deg)
+};
+
+// The rectangular region for which the sun exposure is computed, see the
+// readme for the meaning of the vectors.
+struct Region {
+  Eigen::Vector3d origin{0.0, 0.0, 0.0};
+  Eigen::Vector3d vector1{0.0, 0.0, 0.0};
+  Eigen::Vector3d vector2{0.0, 0.0, 0.0};
+  int stepsV1 = 1;
+  int stepsV2 = 1;
+  double maxHeight = 0.0;
+  double heightIncr = 1.0;
+};
+
+enum class Mode { growseason, monthly, hourly, specificmoment, progressive };
+
+inline bool parseMode(const std::string &name, Mode &mode) {
+  if (name == "growseason") {
+    mode = Mode::growseason;
+  } else if (name == "monthly") {
+    mode = Mode::monthly;
+  } else if (name == "hourly") {
+    mode = Mode::hourly;
+  } else if (name == "specificmoment") {
+    mode = Mode::specificmoment;
+  } else if (name == "progressive") {
+    mode = Mode::progressive;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+inline std::string modeName(Mode mode) {
+  switch (mode) {
+  case Mode::growseason:
+    return "growseason";
+  case Mode::monthly:
+    return "monthly";
+  case Mode::hourly:
+    return "hourly";
+  case Mode::specificmoment:
+    return "specificmoment";
+  case Mode::progressive:
+    return "progressive";
+  }
+  return "";
+}
+
+// Minutes between the time samples of a mode, 0 if they are not evenly spaced
+inline int sampleMinutes(Mode mode) {
+  switch (mode) {
+  case Mode::growseason:
+  case Mode::monthly:
+    return 5;
+  case Mode::hourly:
+  case Mode::specificmoment:
+    return 1;
+  case Mode::progressive:
+    return 0;
+  }
+  return 0;
+}
+
+// Rays per cell over the sun disk for a requested number: the nearest square
+// number up to 16 x 16, 0 (a point sun) if that is a single ray
+inline int sunDiskRays(int requested) {
+  int m = std::min(16, (int)std::lround(std::sqrt(std::max(requested, 0))));
+  return m > 1 ? m * m : 0;
+}
+
+struct RunSettings {
+  Mode mode = Mode::growseason;
+  tm_r date{2020, 1, 1, 12, 0}; // only the relevant fields are used per mode
+  int nThreads = 1;
+  bool showProgress = false;
+  // rays per cell over the sun disk, 0 treats the sun as a point
+  int sunDiskSamples = 0;
+  // progressive mode: stop once the 95% confidence half width of every cell
+  // is below targetError (hours) or after timeBudget seconds, 0 disables
+  double targetError = 0.0;
+  double timeBudget = 0.0;
+  // growseason and monthly: draw quasi random time stamps until every cell
+  // is within targetError instead of the fixed 5 minute steps
+  bool stochasticSampling = false;
+};
+
+// True if the settings give an area sun, which also fills penumbra grids
+inline bool hasAreaSun(const RunSettings &settings) {
+  return sunDiskRays(settings.sunDiskSamples) > 0;
+}
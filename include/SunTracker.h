@@ -16,6 +16,9 @@ public:
 
   void setRelativeRotationAroundZ(double rot) {rotateAroundZ_deg = rot;}
 
+  // Apparent diameter of the sun disk in degrees
+  double getSunDiameter() const { return SunDia; }
+
   Eigen::Vector3d getSunDirection(tm_r tm) {
     double hour = tm.hour + (double)tm.min / 60.0;
     double UT = hour - tzone; // back to universal time
@@ -0,0 +1,48 @@
+#pragma once
+#include "OccluderPruner.h"
+#include "ShadowResult.h"
+#include "SimulationSetup.h"
+#include "WavefrontGeometry.h"
+#include <string>
+
+// Runs a calculation for a region that is too large to keep in memory. The
+// region is split into tiles that are computed one after the other, every
+// tile with only the occluders that can shadow it (see OccluderPruner), and
+// streamed into a MappedResult file. Tiles are sized such that the grids of
+// one tile fit in the memory budget, so the peak memory does not depend on
+// the size of the region. Cells are computed exactly as without tiling.
+class TiledCalculator {
+public:
+  // memoryBudget in bytes, for the grids of a tile (the scene not included)
+  TiledCalculator(const WavefrontGeometry &scene, const Site &site,
+                  const Region &region, size_t memoryBudget);
+
+  // Runs the mode (not progressive, no stochastic sampling, otherwise
+  // std::invalid_argument is thrown) and writes the result to resultPath and,
+  // with an area sun and a penumbraPath, the penumbra fractions
+  void run(const RunSettings &settings, std::string resultPath,
+           std::string penumbraPath = "");
+
+  // Tile size and count of the last run
+  int getTileV1() const { return tileV1; }
+  int getTileV2() const { return tileV2; }
+  int getTileCount() const { return nTiles; }
+  long long getRaysTraced() const { return raysTraced; }
+
+private:
+  const WavefrontGeometry &scene;
+  Site site;
+  Region region;
+  size_t memoryBudget;
+  int tileV1 = 0;
+  int tileV2 = 0;
+  int nTiles = 0;
+  long long raysTraced = 0;
+
+  // Grid values per cell a run of the mode keeps in memory
+  size_t gridsPerCell(const RunSettings &settings) const;
+  // Region covering the cells of a tile, for pruning
+  Region tileRegion(int firstV1, int firstV2, int nV1, int nV2) const;
+  void writeTile(std::string path, const ShadowResult &tile, int firstV1,
+                 int firstV2, bool create) const;
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include "RayTests.h"
+#include <Eigen/Dense>
+#include <vector>
+
+// Bounding volume hierarchy over a set of triangles that each carry the
+// fraction of light they let through. Used as the shared acceleration
+// structure of an instanced prototype.
+class TriangleBvh {
+public:
+  TriangleBvh(std::vector<Triangle> triangles,
+              std::vector<double> transmittance);
+
+  const Eigen::AlignedBox3d &bounds() const { return nodes[0].box; }
+  size_t triangleCount() const { return triangles.size(); }
+
+  // Lowers light to the transmittance of the triangles the ray hits
+  void trace(const Eigen::Vector3d &rayOrigin,
+             const Eigen::Vector3d &direction, double &light) const;
+  // Same for rays sharing their origin, every node is visited once for the
+  // whole packet when any of its rays hits the node
+  void tracePacket(const Eigen::Vector3d &rayOrigin,
+                   const Eigen::Vector3d *directions, size_t nRays,
+                   double *light) const;
+
+private:
+  struct Node {
+    Eigen::AlignedBox3d box;
+    int child = -1; // children at child and child + 1, -1 for a leaf
+    int first = 0;
+    int count = 0;
+  };
+  std::vector<Node> nodes;
+  std::vector<Triangle> triangles;
+  std::vector<double> transmittance;
+
+  void build(int node, int first, int count,
+             std::vector<Eigen::Vector3d> &centroids);
+};
@@ -2,19 +2,62 @@
 #include "WavefrontMatLib.h"
 #include "WavefrontObject.h"
 #include <Eigen/Dense>
+#include <Eigen/Geometry>
 #include <string>
 #include <vector>
 
+// A prototype is a set of objects that is placed in the scene through
+// instances only, its own coordinates are the local frame of the instances.
+struct WavefrontPrototype {
+  std::string name;
+  std::vector<size_t> objects;
+};
+
+struct WavefrontInstance {
+  size_t prototype;
+  Eigen::Affine3d transform; // local frame of the prototype to the scene
+};
+
 class WavefrontGeometry {
 public:
+  // Instances are read from a sidecar file with the same name as the .obj
+  // file but the extension .inst, if it exists. Throws std::runtime_error if
+  // a file can not be read or is malformed.
   WavefrontGeometry(std::string filepath);
+  // For scenes that are constructed in memory, faces index (1 based) into
+  // vertices just like in a .obj file
+  WavefrontGeometry(std::vector<WavefrontObject> objects,
+                    std::vector<Eigen::Vector3d> vertices)
+      : objects(std::move(objects)), vertices(std::move(vertices)){};
+
+  // Returns false if one of the objects does not exist
+  bool definePrototype(std::string name,
+                       const std::vector<std::string> &objectNames);
+  // The name can be a prototype or a single object, returns false if it is
+  // neither
+  bool addInstance(std::string name, const Eigen::Affine3d &transform);
 
   const std::vector<WavefrontObject>& getObjects() const { return objects; }
   const std::vector<Eigen::Vector3d>& getVertices() const { return vertices; }
+  const std::vector<WavefrontPrototype> &getPrototypes() const {
+    return prototypes;
+  }
+  const std::vector<WavefrontInstance> &getInstances() const {
+    return instances;
+  }
+  // Objects that are part of a prototype are not placed in the scene directly
+  bool isPrototypeObject(size_t object) const {
+    return object < prototypeObject.size() && prototypeObject[object];
+  }
 
 private:
   std::vector<WavefrontObject> objects;
   std::vector<Eigen::Vector3d> vertices;
   std::vector<Eigen::Vector2d> textures;
   std::vector<Eigen::Vector3d> normals;
+  std::vector<WavefrontPrototype> prototypes;
+  std::vector<WavefrontInstance> instances;
+  std::vector<bool> prototypeObject;
+
+  void loadInstances(std::string filepath);
 };
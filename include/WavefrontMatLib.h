@@ -8,6 +8,7 @@
 
 class WavefrontMatLib {
 public:
+  // Throws std::runtime_error if the file can not be read
   void loadMaterialLibrary(std::string filepath);
 
   bool matExists(std::string mat) { return (material_library.count(mat) > 0); };
@@ -30,6 +30,8 @@ public:
   void setOpacity(double op) { opacity = op; }
 
   double getOpacity() const {return opacity;}
+  const std::string &getName() const { return name; }
+  const std::string &getMaterial() const { return material; }
 
   const std::vector<Eigen::Matrix3d>& getFaces() const {return faces;}
 
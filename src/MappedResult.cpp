@@ -0,0 +1,118 @@
+#include "MappedResult.h"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+const char magic[8] = {'G', 'S', 'C', 'R', 'E', 'S', 'U', '1'};
+
+// Header fields are 8 bytes apart, heights as doubles, the rest as int64
+struct HeaderWriter {
+  char *p;
+  void put(int64_t value) {
+    std::memcpy(p, &value, sizeof(value));
+    p += sizeof(value);
+  }
+  void put(double value) {
+    std::memcpy(p, &value, sizeof(value));
+    p += sizeof(value);
+  }
+};
+struct HeaderReader {
+  const char *p;
+  int64_t getInt() {
+    int64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return value;
+  }
+  double getDouble() {
+    double value;
+    std::memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return value;
+  }
+};
+} // namespace
+
+size_t MappedResult::headerSize(size_t nLayers) {
+  // magic, mode, rows, cols and the number of layers, then per layer the
+  // height and the five fields of the time
+  return sizeof(magic) + 8 * (4 + 6 * nLayers);
+}
+
+MappedResult::MappedResult(std::string path, Mode mode, int rows, int cols,
+                           const std::vector<ResultLayer> &layers)
+    : mode(mode), nRows(rows), nCols(cols), layers(layers) {
+  boost::iostreams::mapped_file_params params(path);
+  params.flags = boost::iostreams::mapped_file::readwrite;
+  params.new_file_size =
+      headerSize(layers.size()) + layers.size() * layerSize() * sizeof(double);
+  try {
+    file.open(params);
+  } catch (std::exception &e) {
+    throw std::runtime_error("Could not create result file " + path + ": " +
+                             e.what());
+  }
+
+  std::memcpy(file.data(), magic, sizeof(magic));
+  HeaderWriter header{file.data() + sizeof(magic)};
+  header.put((int64_t)mode);
+  header.put((int64_t)rows);
+  header.put((int64_t)cols);
+  header.put((int64_t)layers.size());
+  for (auto &layer : layers) {
+    header.put(layer.height);
+    header.put((int64_t)layer.time.year);
+    header.put((int64_t)layer.time.month);
+    header.put((int64_t)layer.time.day);
+    header.put((int64_t)layer.time.hour);
+    header.put((int64_t)layer.time.min);
+  }
+  values = reinterpret_cast<double *>(file.data() + headerSize(layers.size()));
+}
+
+MappedResult::MappedResult(std::string path) {
+  try {
+    file.open(path, boost::iostreams::mapped_file::readwrite);
+  } catch (std::exception &e) {
+    throw std::runtime_error("Could not open result file " + path + ": " +
+                             e.what());
+  }
+  if (file.size() < headerSize(0) ||
+      std::memcmp(file.data(), magic, sizeof(magic)) != 0) {
+    throw std::runtime_error(path + " is not a result file");
+  }
+  HeaderReader header{file.data() + sizeof(magic)};
+  mode = (Mode)header.getInt();
+  nRows = header.getInt();
+  nCols = header.getInt();
+  size_t nLayers = header.getInt();
+  if (file.size() != headerSize(nLayers) +
+                         nLayers * layerSize() * sizeof(double)) {
+    throw std::runtime_error(path + " has the wrong size");
+  }
+  for (size_t i = 0; i < nLayers; i++) {
+    ResultLayer layer;
+    layer.height = header.getDouble();
+    layer.time.year = header.getInt();
+    layer.time.month = header.getInt();
+    layer.time.day = header.getInt();
+    layer.time.hour = header.getInt();
+    layer.time.min = header.getInt();
+    layers.push_back(layer);
+  }
+  values = reinterpret_cast<double *>(file.data() + headerSize(nLayers));
+}
+
+void MappedResult::writeBlock(const ShadowResult &block, int firstRow,
+                              int firstCol) {
+  if (block.layerCount() != layers.size() ||
+      firstRow + block.rows() > nRows || firstCol + block.cols() > nCols) {
+    throw std::invalid_argument("The block does not fit in the result file");
+  }
+  for (size_t i = 0; i < layers.size(); i++) {
+    layer(i).block(firstRow, firstCol, block.rows(), block.cols()) =
+        block.layer(i);
+  }
+}
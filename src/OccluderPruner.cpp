@@ -0,0 +1,383 @@
+#include "OccluderPruner.h"
+#include "RayTests.h"
+#include "SeasonSampler.h"
+#include "SunTracker.h"
+#include <algorithm>
+#include <array>
+#include <boost/format.hpp>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+// Vertices are only welded when their coordinates are bitwise identical, so
+// the traced geometry does not move
+struct VertexKey {
+  std::array<double, 3> x;
+  bool operator==(const VertexKey &other) const {
+    return std::memcmp(x.data(), other.x.data(), sizeof(x)) == 0;
+  }
+};
+struct VertexKeyHash {
+  size_t operator()(const VertexKey &key) const {
+    size_t seed = 0;
+    for (double value : key.x) {
+      uint64_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      seed ^= std::hash<uint64_t>()(bits) + 0x9e3779b97f4a7c15ULL +
+              (seed << 6) + (seed >> 2);
+    }
+    return seed;
+  }
+};
+
+struct TriangleKey {
+  std::array<size_t, 3> v; // sorted welded vertex indices
+  bool operator==(const TriangleKey &other) const { return v == other.v; }
+};
+struct TriangleKeyHash {
+  size_t operator()(const TriangleKey &key) const {
+    return (key.v[0] * 73856093) ^ (key.v[1] * 19349663) ^
+           (key.v[2] * 83492791);
+  }
+};
+
+double angleDistance(double a, double b) {
+  double d = std::fmod(std::abs(a - b), 2.0 * M_PI);
+  return std::min(d, 2.0 * M_PI - d);
+}
+} // namespace
+
+std::string PruneReport::summary() const {
+  return (boost::format("kept %d of %d triangles (below region: %d, behind "
+                        "region: %d, beyond reach: %d, degenerate: %d, "
+                        "duplicate: %d), %d of %d vertices after welding, "
+                        "%d of %d instances") %
+          trianglesOut % trianglesIn % belowRegion % behindRegion %
+          beyondReach % degenerate % duplicate % verticesOut % verticesIn %
+          instancesOut % instancesIn)
+      .str();
+}
+
+OccluderPruner::OccluderPruner(const Region &region,
+                               const SunEnvelope &envelope)
+    : region(region), envelope(envelope) {
+  Eigen::Vector3d fourth = region.vector1 + region.vector2 - region.origin;
+  Eigen::Vector3d up(0.0, 0.0, region.maxHeight + 1e-6);
+  for (const Eigen::Vector3d &corner :
+       {region.origin, region.vector1, region.vector2, fourth}) {
+    regionCorners.push_back(corner);
+    regionCorners.push_back(corner + up);
+    regionFootprint.extend(Eigen::Vector2d(corner.x(), corner.y()));
+  }
+  regionMinZ = std::min({region.origin.z(), region.vector1.z(),
+                         region.vector2.z(), fourth.z()});
+}
+
+SunEnvelope OccluderPruner::sunEnvelope(const Site &site,
+                                        const RunSettings &settings) {
+  SunTracker sun(site.latitude, site.longitude, site.timezone);
+  sun.setRelativeRotationAroundZ(site.geometryRotation);
+
+  // The modes only sample whole minutes, so sampling every minute of the
+  // covered dates gives every direction a run can use
+  std::vector<tm_r> days;
+  tm_r tm = settings.date;
+  switch (settings.mode) {
+  case Mode::specificmoment:
+    break;
+  case Mode::hourly:
+    days.push_back(tm);
+    break;
+  case Mode::monthly:
+  case Mode::growseason:
+  case Mode::progressive:
+    int first = settings.mode == Mode::monthly ? 1 : 5;
+    int last = settings.mode == Mode::monthly ? 12 : 9;
+    for (tm.month = first; tm.month <= last; tm.month++) {
+      for (tm.day = 1;
+           tm.day <= SeasonSampler::daysInMonth(tm.year, tm.month); tm.day++) {
+        days.push_back(tm);
+      }
+    }
+    break;
+  }
+  std::vector<Eigen::Vector3d> directions;
+  if (settings.mode == Mode::specificmoment) {
+    directions.push_back(sun.getSunDirection(settings.date));
+  }
+  for (tm_r day : days) {
+    for (day.hour = 0; day.hour < 24; day.hour++) {
+      for (day.min = 0; day.min < 60; day.min++) {
+        directions.push_back(sun.getSunDirection(day));
+      }
+    }
+  }
+
+  SunEnvelope envelope;
+  std::vector<double> azimuths;
+  for (auto &d : directions) {
+    if (d[2] < 0.0) {
+      continue; // not traced
+    }
+    double altitude = std::asin(std::min(1.0, d[2]));
+    if (!envelope.sunUp) {
+      envelope.minAltitude = envelope.maxAltitude = altitude;
+    }
+    envelope.sunUp = true;
+    envelope.minAltitude = std::min(envelope.minAltitude, altitude);
+    envelope.maxAltitude = std::max(envelope.maxAltitude, altitude);
+    azimuths.push_back(std::atan2(d[1], d[0]));
+  }
+  if (!envelope.sunUp) {
+    return envelope;
+  }
+
+  // The smallest arc that holds all azimuths lies opposite the largest gap
+  std::sort(azimuths.begin(), azimuths.end());
+  double largestGap = azimuths.front() + 2.0 * M_PI - azimuths.back();
+  envelope.azimuthStart = azimuths.front();
+  for (size_t k = 1; k < azimuths.size(); k++) {
+    if (azimuths[k] - azimuths[k - 1] > largestGap) {
+      largestGap = azimuths[k] - azimuths[k - 1];
+      envelope.azimuthStart = azimuths[k];
+    }
+  }
+  envelope.azimuthWidth = 2.0 * M_PI - largestGap;
+
+  // Pad by the sun disk (area sun) and a little for rounding
+  double pad = (0.5 * 0.53 + 0.01) * M_PI / 180.0;
+  envelope.minAltitude = std::max(0.0, envelope.minAltitude - pad);
+  envelope.maxAltitude = std::min(M_PI / 2.0, envelope.maxAltitude + pad);
+  double cosTop = std::cos(envelope.maxAltitude);
+  double azimuthPad =
+      cosTop > std::sin(pad) ? std::asin(std::sin(pad) / cosTop) : M_PI;
+  envelope.azimuthStart -= azimuthPad;
+  envelope.azimuthWidth =
+      std::min(2.0 * M_PI, envelope.azimuthWidth + 2.0 * azimuthPad);
+  return envelope;
+}
+
+double OccluderPruner::maxProjection(const Eigen::Vector3d &v) const {
+  // d = (cos(alt) cos(az), cos(alt) sin(az), sin(alt)), first the best
+  // azimuth for the horizontal part of v, then the best altitude
+  double horizontal = std::hypot(v.x(), v.y());
+  double bestCos = 1.0;
+  if (horizontal > 0.0) {
+    double azimuth = std::atan2(v.y(), v.x());
+    double offset = std::fmod(azimuth - envelope.azimuthStart, 2.0 * M_PI);
+    if (offset < 0.0) {
+      offset += 2.0 * M_PI;
+    }
+    if (offset > envelope.azimuthWidth) {
+      bestCos = std::cos(std::min(
+          angleDistance(azimuth, envelope.azimuthStart),
+          angleDistance(azimuth,
+                        envelope.azimuthStart + envelope.azimuthWidth)));
+    }
+  }
+  double a = horizontal * bestCos;
+  double b = v.z();
+  double best = std::atan2(b, a);
+  if (best >= envelope.minAltitude && best <= envelope.maxAltitude) {
+    return std::hypot(a, b);
+  }
+  return std::max(
+      a * std::cos(envelope.minAltitude) + b * std::sin(envelope.minAltitude),
+      a * std::cos(envelope.maxAltitude) + b * std::sin(envelope.maxAltitude));
+}
+
+OccluderPruner::Verdict
+OccluderPruner::classify(const std::vector<Eigen::Vector3d> &points) const {
+  if (!envelope.sunUp) {
+    return Verdict::behind; // nothing is traced at all
+  }
+  Eigen::AlignedBox3d box;
+  for (auto &p : points) {
+    box.extend(p);
+  }
+  // rays only go up
+  if (box.max().z() < regionMinZ) {
+    return Verdict::below;
+  }
+  // a ray has climbed above the points before it gets there
+  Eigen::Vector2d gap =
+      (regionFootprint.min() - box.max().head<2>())
+          .cwiseMax(box.min().head<2>() - regionFootprint.max())
+          .cwiseMax(0.0);
+  if (envelope.minAltitude > 0.0 &&
+      regionMinZ + gap.norm() * std::tan(envelope.minAltitude) >
+          box.max().z()) {
+    return Verdict::beyondReach;
+  }
+  // a ray from p can only hit q if d.(q - p) > 0
+  for (auto &q : points) {
+    for (auto &p : regionCorners) {
+      if (maxProjection(q - p) > 0.0) {
+        return Verdict::keep;
+      }
+    }
+  }
+  return Verdict::behind;
+}
+
+WavefrontGeometry OccluderPruner::prune(const WavefrontGeometry &scene,
+                                        PruneReport &report) const {
+  const std::vector<WavefrontObject> &objects = scene.getObjects();
+  const std::vector<Eigen::Vector3d> &vertices = scene.getVertices();
+  report = PruneReport();
+  report.verticesIn = vertices.size();
+  report.instancesIn = scene.getInstances().size();
+
+  // Weld vertices with identical coordinates
+  std::vector<size_t> welded(vertices.size());
+  std::unordered_map<VertexKey, size_t, VertexKeyHash> weldIndex;
+  for (size_t k = 0; k < vertices.size(); k++) {
+    VertexKey key{{vertices[k].x(), vertices[k].y(), vertices[k].z()}};
+    welded[k] = weldIndex.emplace(key, k).first->second;
+  }
+
+  // Decide per face which ones are kept, duplicates keep the copy with the
+  // lowest transmittance as that one determines the light that gets through
+  std::vector<std::vector<char>> keep(objects.size());
+  std::unordered_map<TriangleKey, std::pair<size_t, size_t>, TriangleKeyHash>
+      seen;
+  std::vector<Eigen::Vector3d> points(8);
+  auto count = [&report](Verdict verdict, size_t n) {
+    if (verdict == Verdict::below) {
+      report.belowRegion += n;
+    } else if (verdict == Verdict::behind) {
+      report.behindRegion += n;
+    } else if (verdict == Verdict::beyondReach) {
+      report.beyondReach += n;
+    }
+  };
+  for (size_t o = 0; o < objects.size(); o++) {
+    const std::vector<Eigen::Matrix3d> &faces = objects[o].getFaces();
+    keep[o].assign(faces.size(), 1);
+    if (scene.isPrototypeObject(o)) {
+      continue; // instances are pruned as a whole below
+    }
+    report.trianglesIn += faces.size();
+
+    Eigen::AlignedBox3d bounds;
+    for (auto &face : faces) {
+      for (int v = 0; v < 3; v++) {
+        bounds.extend(vertices[face(v, 0) - 1]);
+      }
+    }
+    for (int c = 0; c < 8 && !faces.empty(); c++) {
+      points[c] = bounds.corner((Eigen::AlignedBox3d::CornerType)c);
+    }
+    Verdict objectVerdict =
+        faces.empty() ? Verdict::keep : classify(points);
+    if (objectVerdict != Verdict::keep) {
+      count(objectVerdict, faces.size());
+      keep[o].assign(faces.size(), 0);
+      continue;
+    }
+
+    std::vector<Eigen::Vector3d> corners(3);
+    for (size_t f = 0; f < faces.size(); f++) {
+      TriangleKey key;
+      for (int v = 0; v < 3; v++) {
+        key.v[v] = welded[faces[f](v, 0) - 1];
+        corners[v] = vertices[key.v[v]];
+      }
+      Eigen::Vector3d normal =
+          (corners[1] - corners[0]).cross(corners[2] - corners[0]);
+      // the tracer never hits triangles with an area this small
+      if (normal.norm() < raytests::eps) {
+        report.degenerate++;
+        keep[o][f] = 0;
+        continue;
+      }
+      Verdict verdict = classify(corners);
+      if (verdict != Verdict::keep) {
+        count(verdict, 1);
+        keep[o][f] = 0;
+        continue;
+      }
+      std::sort(key.v.begin(), key.v.end());
+      auto inserted = seen.emplace(key, std::make_pair(o, f));
+      if (!inserted.second) {
+        report.duplicate++;
+        std::pair<size_t, size_t> &other = inserted.first->second;
+        if (objects[o].getOpacity() > objects[other.first].getOpacity()) {
+          keep[other.first][other.second] = 0;
+          other = {o, f};
+        } else {
+          keep[o][f] = 0;
+        }
+      }
+    }
+  }
+
+  // Rebuild the scene with the kept faces, only referenced vertices remain
+  std::vector<Eigen::Vector3d> newVertices;
+  std::vector<size_t> newIndex(vertices.size(), 0);
+  std::vector<WavefrontObject> newObjects;
+  for (size_t o = 0; o < objects.size(); o++) {
+    WavefrontObject obj;
+    obj.setObjectName(objects[o].getName());
+    obj.setMaterial(objects[o].getMaterial());
+    obj.setOpacity(objects[o].getOpacity());
+    const std::vector<Eigen::Matrix3d> &faces = objects[o].getFaces();
+    for (size_t f = 0; f < faces.size(); f++) {
+      if (!keep[o][f]) {
+        continue;
+      }
+      Eigen::Matrix3d face = faces[f];
+      for (int v = 0; v < 3; v++) {
+        size_t w = welded[face(v, 0) - 1];
+        if (newIndex[w] == 0) {
+          newVertices.push_back(vertices[w]);
+          newIndex[w] = newVertices.size();
+        }
+        face(v, 0) = newIndex[w];
+      }
+      obj.pushFace(face);
+    }
+    if (!scene.isPrototypeObject(o)) {
+      report.trianglesOut += obj.getFaces().size();
+      if (obj.getFaces().empty()) {
+        continue;
+      }
+    }
+    newObjects.push_back(obj);
+  }
+  report.verticesOut = newVertices.size();
+  WavefrontGeometry pruned(std::move(newObjects), std::move(newVertices));
+
+  for (auto &prototype : scene.getPrototypes()) {
+    std::vector<std::string> names;
+    for (size_t o : prototype.objects) {
+      names.push_back(objects[o].getName());
+    }
+    pruned.definePrototype(prototype.name, names);
+  }
+  for (auto &instance : scene.getInstances()) {
+    const WavefrontPrototype &prototype =
+        scene.getPrototypes()[instance.prototype];
+    Eigen::AlignedBox3d local;
+    for (size_t o : prototype.objects) {
+      for (auto &face : objects[o].getFaces()) {
+        for (int v = 0; v < 3; v++) {
+          local.extend(vertices[face(v, 0) - 1]);
+        }
+      }
+    }
+    if (local.isEmpty()) {
+      continue;
+    }
+    for (int c = 0; c < 8; c++) {
+      points[c] = instance.transform *
+                  local.corner((Eigen::AlignedBox3d::CornerType)c);
+    }
+    if (classify(points) == Verdict::keep) {
+      pruned.addInstance(prototype.name, instance.transform);
+      report.instancesOut++;
+    }
+  }
+  return pruned;
+}
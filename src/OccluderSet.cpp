@@ -0,0 +1,148 @@
+#include "OccluderSet.h"
+#include <algorithm>
+#include <cmath>
+
+OccluderSet::OccluderSet(const WavefrontGeometry &scene) {
+  const std::vector<WavefrontObject> &objects = scene.getObjects();
+  const std::vector<Eigen::Vector3d> &vertices = scene.getVertices();
+  auto makeTriangle = [&vertices](const Eigen::Matrix3d &face) {
+    const Eigen::Vector3d &v1 = vertices[face(0, 0) - 1];
+    const Eigen::Vector3d &v2 = vertices[face(1, 0) - 1];
+    const Eigen::Vector3d &v3 = vertices[face(2, 0) - 1];
+    return Triangle{v1, v2 - v1, v3 - v1};
+  };
+
+  for (size_t k = 0; k < objects.size(); k++) {
+    if (scene.isPrototypeObject(k)) {
+      continue; // only traced through its instances
+    }
+    Object occluder;
+    occluder.transmittance = 1.0 - objects[k].getOpacity();
+    occluder.first = triangles.size();
+    for (auto &face : objects[k].getFaces()) {
+      triangles.push_back(makeTriangle(face));
+      occluder.bounds.extend(triangles.back().v1);
+      occluder.bounds.extend(triangles.back().v1 + triangles.back().edge1);
+      occluder.bounds.extend(triangles.back().v1 + triangles.back().edge2);
+    }
+    occluder.last = triangles.size();
+    if (occluder.first != occluder.last) {
+      opaque = opaque && occluder.transmittance <= 0.0;
+      // pad the box so that flat objects keep a volume
+      occluder.bounds.min().array() -= raytests::eps;
+      occluder.bounds.max().array() += raytests::eps;
+      occluders.push_back(occluder);
+    }
+  }
+
+  for (auto &prototype : scene.getPrototypes()) {
+    std::vector<Triangle> protoTriangles;
+    std::vector<double> transmittance;
+    for (size_t k : prototype.objects) {
+      for (auto &face : objects[k].getFaces()) {
+        protoTriangles.push_back(makeTriangle(face));
+        transmittance.push_back(1.0 - objects[k].getOpacity());
+        opaque = opaque && transmittance.back() <= 0.0;
+      }
+    }
+    prototypes.emplace_back(std::move(protoTriangles),
+                            std::move(transmittance));
+  }
+
+  for (auto &instance : scene.getInstances()) {
+    const Eigen::AlignedBox3d &local = prototypes[instance.prototype].bounds();
+    Eigen::AlignedBox3d bounds;
+    for (int c = 0; c < 8 && !local.isEmpty(); c++) {
+      bounds.extend(instance.transform *
+                    local.corner((Eigen::AlignedBox3d::CornerType)c));
+    }
+    if (!bounds.isEmpty()) {
+      instances.push_back(
+          {instance.prototype, instance.transform.inverse(), bounds});
+    }
+  }
+}
+
+size_t OccluderSet::triangleCount() const {
+  size_t count = triangles.size();
+  for (auto &instance : instances) {
+    count += prototypes[instance.prototype].triangleCount();
+  }
+  return count;
+}
+
+double OccluderSet::lightGoingThrough(const Eigen::Vector3d &rayOrigin,
+                                      const Eigen::Vector3d &direction) const {
+  double light = 1.0;
+  for (auto &obj : occluders) {
+    // an object can only lower the light to its own transmittance
+    if (obj.transmittance >= light ||
+        !raytests::rayHitsBox(rayOrigin, direction, obj.bounds)) {
+      continue;
+    }
+    for (size_t t = obj.first; t < obj.last; t++) {
+      if (raytests::rayTriangleIntersect(rayOrigin, direction, triangles[t])) {
+        light = obj.transmittance;
+        break;
+      }
+    }
+    if (light <= 0.0) {
+      return light;
+    }
+  }
+  for (auto &instance : instances) {
+    if (!raytests::rayHitsBox(rayOrigin, direction, instance.bounds)) {
+      continue;
+    }
+    prototypes[instance.prototype].trace(instance.toLocal * rayOrigin,
+                                         instance.toLocal.linear() * direction,
+                                         light);
+    if (light <= 0.0) {
+      break;
+    }
+  }
+  return light;
+}
+
+void OccluderSet::lightGoingThrough(
+    const Eigen::Vector3d &rayOrigin,
+    const std::vector<Eigen::Vector3d> &directions,
+    const Eigen::Vector3d &axis, double coneAngle, double *light) const {
+  size_t nRays = directions.size();
+  std::fill(light, light + nRays, 1.0);
+  double maxLight = 1.0;
+
+  for (auto &obj : occluders) {
+    if (obj.transmittance >= maxLight ||
+        !raytests::coneHitsBox(rayOrigin, axis, coneAngle, obj.bounds)) {
+      continue;
+    }
+    for (size_t t = obj.first; t < obj.last; t++) {
+      raytests::packetTriangleIntersect(rayOrigin, directions.data(), nRays,
+                                        triangles[t], obj.transmittance,
+                                        light);
+    }
+    maxLight = *std::max_element(light, light + nRays);
+    if (maxLight <= 0.0) {
+      return;
+    }
+  }
+
+  if (instances.empty()) {
+    return;
+  }
+  std::vector<Eigen::Vector3d> localDirections(nRays);
+  for (auto &instance : instances) {
+    if (!raytests::coneHitsBox(rayOrigin, axis, coneAngle, instance.bounds)) {
+      continue;
+    }
+    for (size_t r = 0; r < nRays; r++) {
+      localDirections[r] = instance.toLocal.linear() * directions[r];
+    }
+    prototypes[instance.prototype].tracePacket(
+        instance.toLocal * rayOrigin, localDirections.data(), nRays, light);
+    if (*std::max_element(light, light + nRays) <= 0.0) {
+      return;
+    }
+  }
+}
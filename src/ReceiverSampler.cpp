@@ -0,0 +1,148 @@
+#include "ReceiverSampler.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+bool isReceiver(const WavefrontObject &object,
+                const std::vector<std::string> &names) {
+  const std::string &name = object.getName();
+  std::string base = name.substr(0, name.find('_'));
+  for (auto &receiver : names) {
+    if (receiver == name || receiver == base ||
+        (!object.getMaterial().empty() && receiver == object.getMaterial())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// van der Corput sequence in base 2
+double radicalInverse(uint32_t k) {
+  k = (k << 16) | (k >> 16);
+  k = ((k & 0x00ff00ff) << 8) | ((k & 0xff00ff00) >> 8);
+  k = ((k & 0x0f0f0f0f) << 4) | ((k & 0xf0f0f0f0) >> 4);
+  k = ((k & 0x33333333) << 2) | ((k & 0xcccccccc) >> 2);
+  k = ((k & 0x55555555) << 1) | ((k & 0xaaaaaaaa) >> 1);
+  return k * 2.3283064365386963e-10; // 2^-32
+}
+
+// Spreads the lowest 21 bits of v so there are two zero bits between them
+uint64_t spreadBits(uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffff;
+  v = (v | v << 16) & 0x1f0000ff0000ff;
+  v = (v | v << 8) & 0x100f00f00f00f00f;
+  v = (v | v << 4) & 0x10c30c30c30c30c3;
+  v = (v | v << 2) & 0x1249249249249249;
+  return v;
+}
+} // namespace
+
+ReceiverSampler::ReceiverSampler(const WavefrontGeometry &scene,
+                                 const std::vector<std::string> &names,
+                                 double density, bool flipNormals)
+    : flipNormals(flipNormals) {
+  if (density <= 0.0) {
+    throw std::invalid_argument("The receiver density has to be positive");
+  }
+  const std::vector<WavefrontObject> &objects = scene.getObjects();
+  const std::vector<Eigen::Vector3d> &vertices = scene.getVertices();
+  // Points are handed out over the faces in file order, the fraction a face
+  // does not get is carried to the next one so the total matches the area
+  double carry = 0.0;
+  size_t face = 0;
+  for (size_t k = 0; k < objects.size(); k++) {
+    objectNames.push_back(objects[k].getName());
+    bool receiver =
+        !scene.isPrototypeObject(k) && isReceiver(objects[k], names);
+    for (auto &f : objects[k].getFaces()) {
+      if (receiver) {
+        const Eigen::Vector3d &v1 = vertices[f(0, 0) - 1];
+        const Eigen::Vector3d &v2 = vertices[f(1, 0) - 1];
+        const Eigen::Vector3d &v3 = vertices[f(2, 0) - 1];
+        double area = 0.5 * (v2 - v1).cross(v3 - v1).norm();
+        carry += area * density;
+        int n = (int)std::floor(carry);
+        carry -= n;
+        if (area > 0.0) {
+          sampleFace(v1, v2, v3, n, k, face);
+          receiverFaces++;
+        }
+      }
+      face++;
+    }
+  }
+  sortMorton();
+}
+
+void ReceiverSampler::sampleFace(const Eigen::Vector3d &v1,
+                                 const Eigen::Vector3d &v2,
+                                 const Eigen::Vector3d &v3, int n,
+                                 size_t object, size_t face) {
+  Eigen::Vector3d e1 = v2 - v1;
+  Eigen::Vector3d e2 = v3 - v1;
+  Eigen::Vector3d normal = e1.cross(e2).normalized();
+  if (flipNormals) {
+    normal = -normal;
+  }
+  // Stratified in u, van der Corput in v, mapped to the triangle such that
+  // evenly spread (u, v) give evenly spread points
+  for (int k = 0; k < n; k++) {
+    double r = std::sqrt((k + 0.5) / n);
+    double v = radicalInverse(k);
+    points.push_back(
+        ReceiverPoint{v1 + r * (1.0 - v) * e1 + r * v * e2, normal, object,
+                      face});
+  }
+}
+
+uint64_t ReceiverSampler::mortonCode(uint64_t x, uint64_t y, uint64_t z) {
+  return spreadBits(x) | spreadBits(y) << 1 | spreadBits(z) << 2;
+}
+
+void ReceiverSampler::sortMorton() {
+  if (points.empty()) {
+    return;
+  }
+  Eigen::AlignedBox3d bounds;
+  for (auto &point : points) {
+    bounds.extend(point.position);
+  }
+  // the same scale on every axis, so the curve does not stretch the space
+  double scale = ((1 << 21) - 1) / std::max(bounds.sizes().maxCoeff(), 1e-9);
+  std::vector<std::pair<uint64_t, size_t>> codes(points.size());
+  for (size_t p = 0; p < points.size(); p++) {
+    Eigen::Vector3d q = (points[p].position - bounds.min()) * scale;
+    codes[p] = {mortonCode((uint64_t)q.x(), (uint64_t)q.y(), (uint64_t)q.z()),
+                p};
+  }
+  std::sort(codes.begin(), codes.end());
+  std::vector<ReceiverPoint> sorted;
+  sorted.reserve(points.size());
+  for (auto &code : codes) {
+    sorted.push_back(points[code.second]);
+  }
+  points = std::move(sorted);
+}
+
+Region ReceiverSampler::boundingRegion() const {
+  Eigen::AlignedBox3d bounds;
+  for (auto &point : points) {
+    bounds.extend(point.position);
+  }
+  // some margin for the offset of the ray origins along the normals
+  bounds.min().array() -= 1e-3;
+  bounds.max().array() += 1e-3;
+  Region region;
+  region.origin = bounds.min();
+  region.vector1 = Eigen::Vector3d(bounds.max().x(), bounds.min().y(),
+                                   bounds.min().z());
+  region.vector2 = Eigen::Vector3d(bounds.min().x(), bounds.max().y(),
+                                   bounds.min().z());
+  region.stepsV1 = points.size();
+  region.stepsV2 = 1;
+  region.maxHeight = bounds.sizes().z();
+  region.heightIncr = std::max(region.maxHeight, 1e-3);
+  return region;
+}
@@ -0,0 +1,157 @@
+#include "ResultWriter.h"
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <fstream>
+#include <stdexcept>
+
+void ResultWriter::write(const ShadowResult &result, std::string prefix) {
+  writeLayers(result, prefix);
+}
+
+void ResultWriter::write(const MappedResult &result, std::string prefix) {
+  writeLayers(result, prefix);
+}
+
+template <typename Result>
+void ResultWriter::writeLayers(const Result &result, std::string prefix) {
+  // Setup folder for the output
+  checkForDirectory(outputPath);
+  std::string outputDir = outputPath + "/" + modeName(result.getMode());
+  checkForDirectory(outputDir);
+
+  for (size_t i = 0; i < result.layerCount(); i++) {
+    writeEigenArray2DToFile(
+        result.layer(i),
+        outputDir + "/" + prefix +
+            layerFileName(result.getMode(), result.getLayers()[i]));
+  }
+}
+
+void ResultWriter::writeReceivers(const ShadowResult &result,
+                                  const ReceiverSampler &receivers,
+                                  std::string prefix) {
+  std::string fileName =
+      modeFilePath(result.getMode(), prefix + "receivers.txt");
+  std::ofstream outFile(fileName);
+  if (!outFile.is_open()) {
+    throw std::runtime_error("Could not open output file: " + fileName);
+  }
+  // the layer columns are named like the files of a region
+  outFile << "# point object face x y z nx ny nz";
+  for (auto &layer : result.getLayers()) {
+    std::string name = layerFileName(result.getMode(), layer);
+    outFile << " " << name.substr(0, name.size() - 4);
+  }
+  outFile << "\n";
+  const std::vector<ReceiverPoint> &points = receivers.getPoints();
+  for (size_t p = 0; p < points.size(); p++) {
+    const ReceiverPoint &point = points[p];
+    outFile << boost::format("%d %s %d %.4f %.4f %.4f %.4f %.4f %.4f") % p %
+                   receivers.objectName(point.object) % point.face %
+                   point.position.x() % point.position.y() %
+                   point.position.z() % point.normal.x() % point.normal.y() %
+                   point.normal.z();
+    for (size_t i = 0; i < result.layerCount(); i++) {
+      outFile << boost::format(" %6.2f") % result.layer(i)(p, 0);
+    }
+    outFile << "\n";
+  }
+}
+
+void ResultWriter::writeProgressiveUpdate(const ProgressiveUpdate &update) {
+  write(update.estimate);
+  write(update.error, "error_");
+
+  std::string logFile = outputPath + "/" +
+                        modeName(update.estimate.getMode()) +
+                        "/convergence.txt";
+  std::ofstream log(logFile, update.pass == 1 ? std::ios::trunc
+                                              : std::ios::app);
+  if (!log.is_open()) {
+    throw std::runtime_error("Could not open output file: " + logFile);
+  }
+  if (update.pass == 1) {
+    log << "# pass stride samples maxError(h) elapsed(s) converged\n";
+  }
+  log << boost::format("%d %d %d %.4f %.3f %d\n") % update.pass %
+             update.stride % update.samples % update.maxError %
+             update.elapsed % update.converged;
+}
+
+void ResultWriter::writeSamplingSummary(
+    const ShadowResult &error, const std::vector<SamplingSummary> &summary) {
+  write(error, "error_");
+
+  std::string logFile =
+      outputPath + "/" + modeName(error.getMode()) + "/sampling.txt";
+  std::ofstream log(logFile);
+  if (!log.is_open()) {
+    throw std::runtime_error("Could not open output file: " + logFile);
+  }
+  // the period is a month (named like the layer files) or the growseason
+  log << "# period height samples maxError(h) converged\n";
+  for (auto &layer : summary) {
+    const ResultLayer &info = error.getLayers()[layer.layer];
+    std::string period = error.getMode() == Mode::monthly
+                             ? "month_" + std::to_string(info.time.month)
+                             : modeName(error.getMode());
+    log << boost::format("%s %.2f %d %.4f %d\n") % period % info.height %
+               layer.samples % layer.maxError % layer.converged;
+  }
+}
+
+std::string ResultWriter::layerFileName(Mode mode, const ResultLayer &layer) {
+  const tm_r &tm = layer.time;
+  switch (mode) {
+  case Mode::growseason:
+  case Mode::progressive:
+    return (boost::format("height_%.0f.txt") % (layer.height * 100)).str();
+  case Mode::monthly:
+    return (boost::format("month_%d_height_%.0f.txt") % tm.month %
+            (layer.height * 100))
+        .str();
+  case Mode::hourly:
+    return (boost::format("%d%d%d_h%d_height_%.0f.txt") % tm.year % tm.month %
+            tm.day % tm.hour % (layer.height * 100))
+        .str();
+  case Mode::specificmoment:
+    return (boost::format("%d%d%d_%d%d_height_%.0f.txt") % tm.year %
+            tm.month % tm.day % tm.hour % tm.min % (layer.height * 100))
+        .str();
+  }
+  return "";
+}
+
+void ResultWriter::writeEigenArray2DToFile(
+    const Eigen::Ref<const Eigen::ArrayXXd> &arr, std::string filename) {
+  std::ofstream outFile;
+  outFile.open(filename);
+
+  if (outFile.is_open()) {
+    for (int i = 0; i < arr.rows(); i++) {
+      for (int j = 0; j < arr.cols(); j++) {
+        outFile << boost::format("%6.2f ") % arr(i, j);
+      }
+      outFile << "\n";
+    }
+  } else {
+    throw std::runtime_error("Could not open output file: " + filename);
+  }
+}
+
+std::string ResultWriter::modeFilePath(Mode mode, std::string fileName) {
+  checkForDirectory(outputPath);
+  std::string outputDir = outputPath + "/" + modeName(mode);
+  checkForDirectory(outputDir);
+  return outputDir + "/" + fileName;
+}
+
+void ResultWriter::checkForDirectory(std::string foldername) {
+  boost::filesystem::path dir(foldername);
+  if (!boost::filesystem::exists(dir)) {
+    if (!boost::filesystem::create_directory(dir)) {
+      throw std::runtime_error("Was not able to create output directory " +
+                               foldername);
+    }
+  }
+}
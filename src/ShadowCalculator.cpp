@@ -1,285 +1,615 @@
 #include "ShadowCalculator.h"
-#include <boost/filesystem.hpp>
+#include "CellStatistics.h"
+#include "SeasonSampler.h"
+#include <algorithm>
 #include <boost/format.hpp>
+#include <chrono>
+#include <stdexcept>
 #include <omp.h> // OpenMP functions and pragmas
 
-ShadowCalculator::ShadowCalculator(const std::vector<WavefrontObject> &objects,
-                                   const std::vector<Eigen::Vector3d> &vertices,
-                                   SunTracker &sun,
-                                   boost::property_tree::ptree &options)
-    : objects(objects), vertices(vertices), sun(sun), options(options) {
-  stepsV1 = options.get<int>("stepsV1");
-  stepsV2 = options.get<int>("stepsV2");
-
-  nThreads = options.get<int>("nrOfThreads");
-
-  std::stringstream originstream(options.get_child("regionO").data());
-  std::stringstream vector1stream(options.get_child("regionV1").data());
-  std::stringstream vector2stream(options.get_child("regionV2").data());
-
-  double x, y, z;
-  originstream >> x >> y >> z;
-  origin << x, y, z;
-  vector1stream >> x >> y >> z;
-  vector1 << x, y, z;
-  vector2stream >> x >> y >> z;
-  vector2 << x, y, z;
+ShadowCalculator::ShadowCalculator(const WavefrontGeometry &scene,
+                                   const Site &site, const Region &region)
+    : sun(site.latitude, site.longitude, site.timezone),
+      occluders(scene),
+      penumbra(Mode::growseason, region.stepsV1, region.stepsV2),
+      samplingError(Mode::growseason, region.stepsV1, region.stepsV2),
+      visible(region.stepsV1, region.stepsV2) {
+  sun.setRelativeRotationAroundZ(site.geometryRotation);
+
+  origin = region.origin;
+  vector1 = region.vector1;
+  vector2 = region.vector2;
+  stepsV1 = cellsV1 = region.stepsV1;
+  stepsV2 = cellsV2 = region.stepsV2;
+  maxHeight = region.maxHeight;
+  increment = region.heightIncr;
 }
 
-void ShadowCalculator::writeEigenArray2DToFile(Eigen::ArrayXXd arr,
-                                               std::string filename) {
-  std::ofstream outFile;
-  outFile.open(filename);
+void ShadowCalculator::setWindow(int firstV1, int firstV2, int nV1, int nV2) {
+  if (firstV1 < 0 || firstV2 < 0 || nV1 < 1 || nV2 < 1 ||
+      firstV1 + nV1 > cellsV1 || firstV2 + nV2 > cellsV2) {
+    throw std::invalid_argument("The window does not lie within the region");
+  }
+  this->firstV1 = firstV1;
+  this->firstV2 = firstV2;
+  stepsV1 = nV1;
+  stepsV2 = nV2;
+  visible = BitGrid(nV1, nV2);
+}
 
-  if (outFile.is_open()) {
-    for (int i = 0; i < arr.rows(); i++) {
-      for (int j = 0; j < arr.cols(); j++) {
-        outFile << boost::format("%6.2f ") % arr(i, j);
+void ShadowCalculator::setReceivers(const std::vector<ReceiverPoint> &points) {
+  if (points.empty()) {
+    throw std::invalid_argument("There are no receiver points");
+  }
+  receivers = points;
+  firstV1 = firstV2 = 0;
+  stepsV1 = cellsV1 = points.size();
+  stepsV2 = cellsV2 = 1;
+  visible = BitGrid(stepsV1, stepsV2);
+}
+
+void ShadowCalculator::setSunDiskSamples(int n) {
+  // stratified over an m x m grid that is mapped concentrically on the disk
+  diskSamples = sunDiskRays(n);
+  int m = (int)std::lround(std::sqrt(diskSamples));
+  diskOffsets.clear();
+  for (int a = 0; a < m && diskSamples > 0; a++) {
+    for (int b = 0; b < m; b++) {
+      double x = 2.0 * (a + 0.5) / m - 1.0;
+      double y = 2.0 * (b + 0.5) / m - 1.0;
+      double r, phi;
+      if (x == 0.0 && y == 0.0) { // the middle stratum for odd m
+        r = 0.0;
+        phi = 0.0;
+      } else if (std::abs(x) > std::abs(y)) {
+        r = x;
+        phi = M_PI / 4.0 * (y / x);
+      } else {
+        r = y;
+        phi = M_PI / 2.0 - M_PI / 4.0 * (x / y);
       }
-      outFile << "\n";
+      diskOffsets.emplace_back(r * std::cos(phi), r * std::sin(phi), 0.0);
     }
-  } else {
-    std::cout << "Could not open output file: " << filename << "\n";
   }
 }
 
-void ShadowCalculator::checkForDirectory(std::string foldername) {
-  boost::filesystem::path dir(foldername);
-  if (!boost::filesystem::exists(dir)) {
-    if (!boost::filesystem::create_directory(dir)) {
-      std::cout
-          << "Was not able to create output directory, terminating program\n";
-      exit(EXIT_FAILURE);
+void ShadowCalculator::setSunDirection(const Eigen::Vector3d &direction) {
+  sunDir = direction;
+  if (diskSamples == 0) {
+    return;
+  }
+  // spread the offsets over the disk perpendicular to the sun direction
+  double radius = std::tan(0.5 * sun.getSunDiameter() * M_PI / 180.0);
+  Eigen::Vector3d t1 = sunDir.unitOrthogonal();
+  Eigen::Vector3d t2 = sunDir.cross(t1);
+  diskDirections.resize(diskOffsets.size());
+  for (size_t k = 0; k < diskOffsets.size(); k++) {
+    diskDirections[k] = (sunDir + radius * (diskOffsets[k].x() * t1 +
+                                            diskOffsets[k].y() * t2))
+                            .normalized();
+  }
+}
+
+double ShadowCalculator::sunLight(const Eigen::Vector3d &rayOrigin,
+                                  bool &partial,
+                                  const Eigen::Vector3d *normal) const {
+  partial = false;
+  if (diskSamples == 0) {
+    if (normal && normal->dot(sunDir) <= 0.0) {
+      return 0.0; // the sun is behind the face
+    }
+    return occluders.lightGoingThrough(rayOrigin, sunDir);
+  }
+  double light[256];
+  // cone half angle with some margin for the normalization of the directions
+  double coneAngle = 0.5 * sun.getSunDiameter() * M_PI / 180.0 * 1.01;
+  occluders.lightGoingThrough(rayOrigin, diskDirections, sunDir, coneAngle,
+                              light);
+  // near grazing angles only part of the disk is in front of the face
+  for (int k = 0; normal && k < diskSamples; k++) {
+    if (normal->dot(diskDirections[k]) <= 0.0) {
+      light[k] = 0.0;
+    }
+  }
+  double sum = 0.0;
+  double minLight = light[0];
+  double maxLight = light[0];
+  for (int k = 0; k < diskSamples; k++) {
+    sum += light[k];
+    minLight = std::min(minLight, light[k]);
+    maxLight = std::max(maxLight, light[k]);
+  }
+  partial = minLight < maxLight;
+  return sum / diskSamples;
+}
+
+double ShadowCalculator::cellLight(int i, int j, double height,
+                                   bool &partial) const {
+  return sunLight(cellOrigin(i, j, height), partial,
+                  receivers.empty() ? nullptr : &receivers[i].normal);
+}
+
+std::vector<double> ShadowCalculator::layerHeights(bool belowMax) const {
+  if (!receivers.empty()) {
+    return {0.0}; // the points are on the surfaces themselves
+  }
+  std::vector<double> heights;
+  for (double height = 0;
+       belowMax ? height < maxHeight : height <= maxHeight;
+       height += increment) {
+    heights.push_back(height);
+  }
+  return heights;
+}
+
+size_t ShadowCalculator::addLayer(ShadowResult &result, double height,
+                                  tm_r tm) {
+  if (diskSamples > 0) {
+    penumbra.addLayer(height, tm);
+    penumbraSamples.push_back(0);
+  }
+  return result.addLayer(height, tm);
+}
+
+void ShadowCalculator::resetPenumbra(Mode mode) {
+  penumbra = ShadowResult(mode, stepsV1, stepsV2);
+  penumbraSamples.clear();
+}
+
+void ShadowCalculator::addPenumbraSample(size_t layer) {
+  if (diskSamples > 0 && sunUp) {
+    penumbra.layer(layer) += penumbraSample;
+    penumbraSamples[layer]++;
+  }
+}
+
+void ShadowCalculator::finishPenumbra() {
+  for (size_t layer = 0; layer < penumbra.layerCount(); layer++) {
+    if (penumbraSamples[layer] > 0) {
+      penumbra.layer(layer) /= penumbraSamples[layer];
     }
   }
 }
 
 void ShadowCalculator::progressBar(double partDone) {
+  if (!showProgress) {
+    return;
+  }
   std::cout << boost::format("\rprogress: %6.2f%%") % (partDone * 100)
             << std::flush;
 }
 
-void ShadowCalculator::growSeasonAverage() {
-  // Setup folder for the output
-  checkForDirectory(options.get<std::string>("outputPath"));
-  std::string outputDir =
-      options.get<std::string>("outputPath") + "/growseason";
-  checkForDirectory(outputDir);
+ShadowResult ShadowCalculator::run(const RunSettings &settings) {
+  nThreads = settings.nThreads;
+  showProgress = settings.showProgress;
+  setSunDiskSamples(settings.sunDiskSamples);
+  switch (settings.mode) {
+  case Mode::monthly:
+    if (settings.stochasticSampling) {
+      return sampledAverage(Mode::monthly, settings.date.year,
+                            settings.targetError);
+    }
+    return monthly(settings.date.year);
+  case Mode::hourly:
+    return hourly(settings.date);
+  case Mode::specificmoment:
+    return specificMoment(settings.date);
+  case Mode::progressive:
+    return progressive(settings.date.year, settings.targetError,
+                       settings.timeBudget);
+  case Mode::growseason:
+  default:
+    if (settings.stochasticSampling) {
+      return sampledAverage(Mode::growseason, settings.date.year,
+                            settings.targetError);
+    }
+    return growSeasonAverage(settings.date.year);
+  }
+}
 
+ShadowResult ShadowCalculator::growSeasonAverage(int year) {
+  ShadowResult result(Mode::growseason, stepsV1, stepsV2);
+  resetPenumbra(Mode::growseason);
   int iterations = 0;
+  BitGridCounter counter(stepsV1, stepsV2);
 
   tm_r tm;
-  tm.year = options.get<int>("date.year");
+  tm.year = year;
 
   // Doing the calculations
-  Eigen::ArrayXXd cumSum;
-  std::string outputFile;
-  double maxHeight = options.get<double>("maxHeight");
-  double increment = options.get<double>("heightIncr");
-  for (double height = 0; height <= maxHeight; height += increment) {
+  std::vector<double> heights = layerHeights(false);
+  for (size_t h = 0; h < heights.size(); h++) {
+    double height = heights[h];
     iterations = 0;
-    cumSum = Eigen::ArrayXXd::Zero(stepsV1, stepsV2);
+    size_t layer = addLayer(result, height, tm);
+    Eigen::Map<Eigen::ArrayXXd> cumSum = result.layer(layer);
     for (tm.month = 5; tm.month < 10; tm.month++) {
-      progressBar((height / (maxHeight + increment) +
-                   increment * (tm.month - 4.0) / 5.0 / maxHeight));
+      progressBar((h + (tm.month - 5.0) / 5.0) / heights.size());
       for (tm.day = 1; tm.day < 31; tm.day++) {
         for (tm.hour = 0; tm.hour < 24; tm.hour++) {
           for (tm.min = 0; tm.min < 60; tm.min += 5) {
-            cumSum += computeShadow(tm, height);
+            addSample(tm, height, cumSum, counter);
+            addPenumbraSample(layer);
             iterations++;
           }
         }
       }
     }
+    addCounts(cumSum, counter);
 
     cumSum = 24.0 * cumSum / iterations;
-    // write the results to a file
-    outputFile =
-        outputDir + (boost::format("/height_%.0f.txt") % (height * 100)).str();
-    writeEigenArray2DToFile(cumSum, outputFile);
   }
-  std::cout << std::endl; // end line after progress bar
+  finishPenumbra();
+  if (showProgress) {
+    std::cout << std::endl; // end line after progress bar
+  }
+  return result;
 }
 
-void ShadowCalculator::monthly() {
-  // Setup folder for the output
-  checkForDirectory(options.get<std::string>("outputPath"));
-  std::string outputDir = options.get<std::string>("outputPath") + "/monthly";
-  checkForDirectory(outputDir);
-
+ShadowResult ShadowCalculator::monthly(int year) {
+  ShadowResult result(Mode::monthly, stepsV1, stepsV2);
+  resetPenumbra(Mode::monthly);
   int iterations = 0;
+  BitGridCounter counter(stepsV1, stepsV2);
   tm_r tm;
-  tm.year = options.get<int>("date.year");
-
-  Eigen::ArrayXXd cumSum;
-  std::string outputFile;
-  double maxHeight = options.get<double>("maxHeight");
-  double increment = options.get<double>("heightIncr");
+  tm.year = year;
 
   // Doing the calculations
+  std::vector<double> heights = layerHeights(false);
   for (tm.month = 1; tm.month <= 12; tm.month++) {
-    for (double height = 0; height <= maxHeight; height += increment) {
+    for (size_t h = 0; h < heights.size(); h++) {
+      double height = heights[h];
       iterations = 0;
-      cumSum = Eigen::ArrayXXd::Zero(stepsV1, stepsV2);
-      progressBar(
-          ((tm.month - 1.0) / 12 + height / (maxHeight + increment) / 12));
+      size_t layer = addLayer(result, height, tm);
+      Eigen::Map<Eigen::ArrayXXd> cumSum = result.layer(layer);
+      progressBar((tm.month - 1.0 + (double)h / heights.size()) / 12);
       for (tm.day = 1; tm.day < 31; tm.day++) {
         for (tm.hour = 0; tm.hour < 24; tm.hour++) {
           for (tm.min = 0; tm.min < 60; tm.min += 5) {
-            cumSum += computeShadow(tm, height);
+            addSample(tm, height, cumSum, counter);
+            addPenumbraSample(layer);
             iterations++;
           }
         }
       }
+      addCounts(cumSum, counter);
       cumSum = 24.0 * cumSum / iterations;
-      // write the results to a file
-      outputFile = outputDir + (boost::format("/month_%d_height_%.0f.txt") %
-                                tm.month % (height * 100))
-                                   .str();
-      writeEigenArray2DToFile(cumSum, outputFile);
     }
   }
-  std::cout << std::endl; // end line after progress bar
+  finishPenumbra();
+  if (showProgress) {
+    std::cout << std::endl; // end line after progress bar
+  }
+  return result;
 }
 
-void ShadowCalculator::specificMoment() {
-  // Setup folder for the output
-  checkForDirectory(options.get<std::string>("outputPath"));
-  std::string outputDir =
-      options.get<std::string>("outputPath") + "/specificmoment";
-  checkForDirectory(outputDir);
-
-  int iterations = 0;
-  tm_r tm;
-  tm.year = options.get<int>("date.year");
-  tm.month = options.get<int>("month");
-  tm.day = options.get<int>("day");
-  tm.hour = options.get<int>("hour");
-  tm.min = options.get<int>("minute");
-
-  Eigen::ArrayXXd cumSum;
-  std::string outputFile;
-  double maxHeight = options.get<double>("maxHeight");
-  double increment = options.get<double>("heightIncr");
+ShadowResult ShadowCalculator::specificMoment(tm_r tm) {
+  ShadowResult result(Mode::specificmoment, stepsV1, stepsV2);
+  resetPenumbra(Mode::specificmoment);
 
   // Doing the calculations
-  for (double height = 0; height < maxHeight; height += increment) {
-    outputFile =
-        outputDir + (boost::format("/%d%d%d_%d%d_height_%.0f.txt") % tm.year %
-                     tm.month % tm.day % tm.hour % tm.min % (height * 100))
-                        .str();
-    writeEigenArray2DToFile(computeShadow(tm, height), outputFile);
+  for (double height : layerHeights(true)) {
+    size_t layer = addLayer(result, height, tm);
+    result.layer(layer) = computeShadow(tm, height);
+    addPenumbraSample(layer);
   }
+  finishPenumbra();
+  return result;
 }
 
-void ShadowCalculator::hourly() {
-  // Setup folder for the output
-  checkForDirectory(options.get<std::string>("outputPath"));
-  std::string outputDir = options.get<std::string>("outputPath") + "/hourly";
-  checkForDirectory(outputDir);
-
+ShadowResult ShadowCalculator::hourly(tm_r date) {
+  ShadowResult result(Mode::hourly, stepsV1, stepsV2);
+  resetPenumbra(Mode::hourly);
   int iterations = 0;
+  BitGridCounter counter(stepsV1, stepsV2);
 
   tm_r tm;
-  tm.year = options.get<int>("date.year");
-  tm.month = options.get<int>("date.month");
-  tm.day = options.get<int>("date.day");
+  tm.year = date.year;
+  tm.month = date.month;
+  tm.day = date.day;
 
   // Doing the calculations
-  Eigen::ArrayXXd cumSum;
-  std::string outputFile;
-  double maxHeight = options.get<double>("maxHeight");
-  double increment = options.get<double>("heightIncr");
+  std::vector<double> heights = layerHeights(true);
   for (tm.hour = 0; tm.hour < 24; tm.hour++) {
-    for (double height = 0; height < maxHeight; height += increment) {
-      progressBar(1.0 * tm.hour / 24.0 + (height + increment) / maxHeight / 24);
+    for (size_t h = 0; h < heights.size(); h++) {
+      double height = heights[h];
+      progressBar((tm.hour + (h + 1.0) / heights.size()) / 24.0);
       iterations = 0;
-      cumSum = Eigen::ArrayXXd::Zero(stepsV1, stepsV2);
+      tm.min = 0;
+      size_t layer = addLayer(result, height, tm);
+      Eigen::Map<Eigen::ArrayXXd> cumSum = result.layer(layer);
       for (tm.min = 0; tm.min < 60; tm.min++) {
-        cumSum += computeShadow(tm, height);
+        addSample(tm, height, cumSum, counter);
+        addPenumbraSample(layer);
         iterations++;
       }
-      outputFile =
-          outputDir + (boost::format("/%d%d%d_h%d_height_%.0f.txt") % tm.year %
-                       tm.month % tm.day % tm.hour % (height * 100))
-                          .str();
-      writeEigenArray2DToFile(cumSum, outputFile);
+      addCounts(cumSum, counter);
+    }
+  }
+  finishPenumbra();
+  if (showProgress) {
+    std::cout << std::endl; // for the progress bar
+  }
+  return result;
+}
+
+ShadowResult ShadowCalculator::progressive(int year, double targetError,
+                                           double timeBudget) {
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = [&start]() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  };
+  const long minSamples = 64; // before trusting the variance estimates
+  SeasonSampler sampler(year, 5, 9);
+  // Without target or budget stop at the sample density of growSeasonAverage
+  const long maxSamples = sampler.getDays() * 24L * 12L;
+
+  tm_r tm{year, 5, 1, 0, 0};
+  ShadowResult estimate(Mode::progressive, stepsV1, stepsV2);
+  ShadowResult error(Mode::progressive, stepsV1, stepsV2);
+  resetPenumbra(Mode::progressive); // no penumbra grids in this mode
+  std::vector<double> heights = layerHeights(false);
+  std::vector<CellStatistics> stats;
+  for (double height : heights) {
+    stats.emplace_back(stepsV1, stepsV2);
+    estimate.addLayer(height, tm);
+    error.addLayer(height, tm);
+  }
+
+  // Start on a grid with about 8 traced points in the longest direction,
+  // every pass halves the stride and doubles the number of time samples
+  int stride = 1;
+  while (std::max(stepsV1, stepsV2) / (2 * stride) >= 8) {
+    stride *= 2;
+  }
+  long samples = 0;
+  long passSamples = 16;
+  std::vector<std::pair<int, int>> cells;
+  std::vector<double> light;
+
+  for (int pass = 1;; pass++) {
+    if (pass > 1 && stride > 1) {
+      stride /= 2;
+    }
+    cells.clear();
+    for (int i = 0; i < stepsV1; i += stride) {
+      for (int j = 0; j < stepsV2; j += stride) {
+        cells.emplace_back(i, j);
+      }
+    }
+    light.resize(cells.size());
+
+    bool outOfTime = false;
+    long passEnd = std::min(samples + passSamples, maxSamples);
+    for (; samples < passEnd && !outOfTime; samples++) {
+      setSunDirection(sun.getSunDirection(sampler.sample(samples)));
+      for (size_t h = 0; h < heights.size(); h++) {
+        if (sunDir[2] < 0.0) { // the sun is below the horizon
+          std::fill(light.begin(), light.end(), 0.0);
+        } else {
+          raysTraced += cells.size() * std::max(diskSamples, 1);
+#pragma omp parallel for num_threads(nThreads)
+          for (size_t c = 0; c < cells.size(); c++) {
+            bool partial;
+            light[c] =
+                cellLight(cells[c].first, cells[c].second, heights[h], partial);
+          }
+        }
+        for (size_t c = 0; c < cells.size(); c++) {
+          stats[h].add(cells[c].first, cells[c].second, light[c]);
+        }
+      }
+      outOfTime = timeBudget > 0.0 && elapsed() > timeBudget;
+    }
+    passSamples *= 2;
+
+    // Cells that are not traced yet take the value of the traced point of
+    // their coarse cell
+    double maxError = 0.0;
+    double fewestSamples = INFINITY;
+    for (size_t h = 0; h < heights.size(); h++) {
+      Eigen::Map<Eigen::ArrayXXd> est = estimate.layer(h);
+      Eigen::Map<Eigen::ArrayXXd> err = error.layer(h);
+      for (int i = 0; i < stepsV1; i++) {
+        for (int j = 0; j < stepsV2; j++) {
+          int ci = i - i % stride;
+          int cj = j - j % stride;
+          est(i, j) = 24.0 * stats[h].mean(ci, cj);
+          err(i, j) = 24.0 * stats[h].halfWidth(ci, cj);
+        }
+      }
+      for (auto &cell : cells) {
+        maxError = std::max(maxError, err(cell.first, cell.second));
+        fewestSamples =
+            std::min(fewestSamples, stats[h].samples(cell.first, cell.second));
+      }
+    }
+
+    bool converged = stride == 1 && fewestSamples >= minSamples &&
+                     targetError > 0.0 && maxError <= targetError;
+    bool final = converged || outOfTime ||
+                 (stride == 1 && samples >= maxSamples);
+    if (onUpdate) {
+      onUpdate(ProgressiveUpdate{pass, stride, samples, maxError, elapsed(),
+                                 converged, final, estimate, error});
+    }
+    if (final) {
+      return estimate;
     }
   }
-  std::cout << std::endl; // for the progress bar
+}
+
+ShadowResult ShadowCalculator::sampledAverage(Mode mode, int year,
+                                              double targetError) {
+  const long minSamples = 64; // before trusting the variance estimates
+  const long checkInterval = 64;
+  ShadowResult result(mode, stepsV1, stepsV2);
+  samplingError = ShadowResult(mode, stepsV1, stepsV2);
+  samplingSummary.clear();
+  resetPenumbra(mode); // no penumbra grids with sampled time stamps
+
+  std::vector<double> heights = layerHeights(false);
+  // growseason is a single period, monthly has one per month
+  int periods = mode == Mode::monthly ? 12 : 1;
+  for (int p = 0; p < periods; p++) {
+    int firstMonth = mode == Mode::monthly ? p + 1 : 5;
+    int lastMonth = mode == Mode::monthly ? p + 1 : 9;
+    SeasonSampler sampler(year, firstMonth, lastMonth);
+    const long maxSamples = sampler.getDays() * 24L * 12L;
+    std::vector<CellStatistics> stats(heights.size(),
+                                      CellStatistics(stepsV1, stepsV2));
+    std::vector<double> maxError(heights.size(), INFINITY);
+    auto largestError = [&]() {
+      for (size_t h = 0; h < heights.size(); h++) {
+        maxError[h] = 0.0;
+        for (int i = 0; i < stepsV1; i++) {
+          for (int j = 0; j < stepsV2; j++) {
+            maxError[h] =
+                std::max(maxError[h], 24.0 * stats[h].halfWidth(i, j));
+          }
+        }
+      }
+      return *std::max_element(maxError.begin(), maxError.end());
+    };
+
+    // on the binary path the lit samples are counted in bits and moved into
+    // the statistics before the errors are checked
+    std::vector<BitGridCounter> counters(
+        binaryVisibility() ? heights.size() : 0,
+        BitGridCounter(stepsV1, stepsV2));
+    long pending = 0;
+    auto moveCounts = [&]() {
+      for (size_t h = 0; h < counters.size(); h++) {
+        stats[h].addLitCounts(counters[h].counts(), pending);
+        counters[h].clear();
+      }
+      pending = 0;
+    };
+
+    long samples = 0;
+    bool converged = false;
+    while (samples < maxSamples && !converged) {
+      tm_r tm = sampler.sample(samples);
+      for (size_t h = 0; h < heights.size(); h++) {
+        if (!binaryVisibility()) {
+          stats[h].add(computeShadow(tm, heights[h]));
+        } else if (computeVisibility(tm, heights[h])) {
+          counters[h].add(visible);
+        }
+      }
+      samples++;
+      pending++;
+      if (samples >= minSamples && samples % checkInterval == 0) {
+        moveCounts();
+        progressBar((p + (double)samples / maxSamples) / periods);
+        converged = targetError > 0.0 && largestError() <= targetError;
+      }
+    }
+    moveCounts();
+    largestError();
+
+    tm_r tm{year, firstMonth, 1, 0, 0};
+    for (size_t h = 0; h < heights.size(); h++) {
+      size_t layer = result.addLayer(heights[h], tm);
+      samplingError.addLayer(heights[h], tm);
+      Eigen::Map<Eigen::ArrayXXd> est = result.layer(layer);
+      Eigen::Map<Eigen::ArrayXXd> err = samplingError.layer(layer);
+      for (int i = 0; i < stepsV1; i++) {
+        for (int j = 0; j < stepsV2; j++) {
+          est(i, j) = 24.0 * stats[h].mean(i, j);
+          err(i, j) = 24.0 * stats[h].halfWidth(i, j);
+        }
+      }
+      samplingSummary.push_back({layer, samples, maxError[h], converged});
+    }
+  }
+  if (showProgress) {
+    std::cout << std::endl; // end line after progress bar
+  }
+  return result;
 }
 
 Eigen::ArrayXXd ShadowCalculator::computeShadow(tm_r tm, double height) {
   Eigen::ArrayXXd sunCollector = Eigen::ArrayXXd::Zero(stepsV1, stepsV2);
-  double lightGoingThrough = 1.0;
-  sunDir = sun.getSunDirection(tm);
-  if (sunDir[2] < 0.0) { // the sun is below the horizon
+  setSunDirection(sun.getSunDirection(tm));
+  sunUp = sunDir[2] >= 0.0;
+  if (!sunUp) { // the sun is below the horizon
+    if (onSample) {
+      onSample(tm, height, sunCollector);
+    }
     return sunCollector;
   }
-// Define a reduction for the eigen array class
-#pragma omp declare reduction (+: Eigen::ArrayXXd: omp_out=omp_out+omp_in)\
-     initializer(omp_priv=Eigen::ArrayXXd::Zero(omp_orig.rows(), omp_orig.cols()))
-#pragma omp parallel for num_threads(nThreads) default(none) private(                        \
-    lightGoingThrough, ray_origin) shared(height, vector1, vector2, origin, stepsV1, stepsV2, objects) reduction(+:sunCollector)
+  raysTraced += (long long)stepsV1 * stepsV2 * std::max(diskSamples, 1);
+  penumbraSample.setZero(stepsV1, stepsV2);
+  // every cell is written by exactly one thread, so no reduction is needed
+#pragma omp parallel for num_threads(nThreads)
   for (int i = 0; i < stepsV1; i++) {
     for (int j = 0; j < stepsV2; j++) {
-      // why (i+0.5):  0.5 gets us to the center of a cell
-      ray_origin = origin + (vector1 - origin) / stepsV1 * (i + 0.5) +
-                   (vector2 - origin) * (j + 0.5) / stepsV2 +
-                   (height + 1e-6) * z_axis;
-      lightGoingThrough = 1.0;
-      for (auto &obj : objects) {
-        for (auto &face : obj.getFaces()) {
-          if (ray_triangle_intersect(
-                  ray_origin, sunDir, vertices[face(0, 0) - 1],
-                  vertices[face(1, 0) - 1], vertices[face(2, 0) - 1])) {
-            if (lightGoingThrough > (1.0 - obj.getOpacity())) {
-              lightGoingThrough = 1.0 - obj.getOpacity();
-            }
-          }
-        }
-      }
-      sunCollector(i, j) += lightGoingThrough;
+      bool partial;
+      sunCollector(i, j) = cellLight(i, j, height, partial);
+      penumbraSample(i, j) = partial ? 1.0 : 0.0;
     }
   }
+  if (onSample) {
+    onSample(tm, height, sunCollector);
+  }
   return sunCollector;
 }
 
-bool ShadowCalculator::ray_triangle_intersect(Eigen::Vector3d ray_origin,
-                                              Eigen::Vector3d ray_direction,
-                                              Eigen::Vector3d v1,
-                                              Eigen::Vector3d v2,
-                                              Eigen::Vector3d v3) {
-  double eps = 1e-6;
-  Eigen::Vector3d edge1 = v2 - v1;
-  Eigen::Vector3d edge2 = v3 - v1;
-  Eigen::Vector3d h = ray_direction.cross(edge2);
-  double a = edge1.dot(h);
-
-  if (abs(a) < eps) {
-    return false;
+bool ShadowCalculator::computeVisibility(tm_r tm, double height) {
+  setSunDirection(sun.getSunDirection(tm));
+  sunUp = sunDir[2] >= 0.0;
+  visible.clear();
+  if (sunUp) {
+    raysTraced += (long long)stepsV1 * stepsV2;
+    // every row has its own words, so threads never write the same word
+#pragma omp parallel for num_threads(nThreads)
+    for (int i = 0; i < stepsV1; i++) {
+      uint64_t *row = visible.row(i);
+      for (int j = 0; j < stepsV2; j++) {
+        bool partial;
+        if (cellLight(i, j, height, partial) > 0.0) {
+          row[j / 64] |= uint64_t(1) << (j % 64);
+        }
+      }
+    }
   }
-
-  double f = 1.0 / a;
-  Eigen::Vector3d s = ray_origin - v1;
-  double u = f * s.dot(h);
-
-  if (u < 0.0 || u > 1.0) {
-    return false;
+  if (onVisibility) {
+    onVisibility(tm, height, visible);
+  } else if (onSample) {
+    onSample(tm, height, visible.toArray());
   }
+  return sunUp;
+}
 
-  Eigen::Vector3d q = s.cross(edge1);
-  double v = f * ray_direction.dot(q);
-
-  if ((v < 0.0) || (u + v) > 1.0) {
-    return false;
+void ShadowCalculator::addSample(tm_r tm, double height,
+                                 Eigen::Map<Eigen::ArrayXXd> &cumSum,
+                                 BitGridCounter &counter) {
+  if (!binaryVisibility()) {
+    cumSum += computeShadow(tm, height);
+  } else if (computeVisibility(tm, height)) {
+    counter.add(visible);
   }
+}
 
-  double t = f * edge2.dot(q);
+void ShadowCalculator::addCounts(Eigen::Map<Eigen::ArrayXXd> &cumSum,
+                                 BitGridCounter &counter) {
+  if (binaryVisibility()) {
+    cumSum += counter.counts();
+    counter.clear();
+  }
+}
 
-  if (t > eps) {
-    return true;
-  } else {
-    return false;
+Eigen::Vector3d ShadowCalculator::cellOrigin(int i, int j,
+                                             double height) const {
+  if (!receivers.empty()) { // just off the surface, on the side of the normal
+    return receivers[i].position + 1e-6 * receivers[i].normal;
   }
-}
\ No newline at end of file
+  // why (i+0.5):  0.5 gets us to the center of a cell
+  i += firstV1;
+  j += firstV2;
+  return origin + (vector1 - origin) / cellsV1 * (i + 0.5) +
+         (vector2 - origin) * (j + 0.5) / cellsV2 + (height + 1e-6) * z_axis;
+}
@@ -0,0 +1,321 @@
+#include "ShadowMaskStore.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+const char magic[8] = {'G', 'S', 'C', 'M', 'A', 'S', 'K', '1'};
+
+size_t wordCount(int rows, int cols) {
+  return ((size_t)rows * cols + 63) / 64;
+}
+
+int dateKey(const tm_r &tm) {
+  return tm.year * 10000 + tm.month * 100 + tm.day;
+}
+
+template <typename T> void put(std::ostream &out, const T &value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> T get(std::istream &in) {
+  T value{};
+  in.read(reinterpret_cast<char *>(&value), sizeof(T));
+  return value;
+}
+
+template <typename T> void append(std::vector<uint8_t> &bytes, const T &value) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(&value);
+  bytes.insert(bytes.end(), p, p + sizeof(T));
+}
+
+void appendVarint(std::vector<uint8_t> &bytes, uint64_t value) {
+  while (value >= 0x80) {
+    bytes.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  bytes.push_back((uint8_t)value);
+}
+
+uint64_t readVarint(const uint8_t *&p) {
+  uint64_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    value |= (uint64_t)(*p & 0x7f) << shift;
+    if (!(*p++ & 0x80)) {
+      return value;
+    }
+  }
+}
+} // namespace
+
+ShadowMaskWriter::ShadowMaskWriter(std::string path, int rows, int cols,
+                                   int sampleMinutes, double threshold)
+    : out(path, std::ios::binary), rows(rows), cols(cols),
+      threshold(threshold) {
+  if (!out) {
+    throw std::runtime_error("Could not open shadow mask file " + path);
+  }
+  out.write(magic, sizeof(magic));
+  put<int32_t>(out, rows);
+  put<int32_t>(out, cols);
+  put<int32_t>(out, sampleMinutes);
+  put<double>(out, threshold);
+  previous.assign(wordCount(rows, cols), 0);
+  current.assign(wordCount(rows, cols), 0);
+  open = true;
+}
+
+ShadowMaskWriter::~ShadowMaskWriter() { close(); }
+
+void ShadowMaskWriter::record(const tm_r &tm, double height,
+                              const Eigen::ArrayXXd &light) {
+  beginSample(tm, height);
+  const double *values = light.data(); // column major, like the masks
+  for (size_t k = 0; k < (size_t)rows * cols; k++) {
+    if (values[k] >= threshold) {
+      current[k / 64] |= uint64_t(1) << (k % 64);
+    }
+  }
+  encodeSample();
+}
+
+void ShadowMaskWriter::record(const tm_r &tm, double height,
+                              const BitGrid &lit) {
+  beginSample(tm, height);
+  // the grid packs rows, the masks are column major
+  for (int i = 0; i < rows; i++) {
+    const uint64_t *row = lit.getWords().data() + (size_t)i * lit.wordsPerRow();
+    for (int w = 0; w < lit.wordsPerRow(); w++) {
+      for (uint64_t bits = row[w]; bits; bits &= bits - 1) {
+        size_t k = i + (size_t)(w * 64 + __builtin_ctzll(bits)) * rows;
+        current[k / 64] |= uint64_t(1) << (k % 64);
+      }
+    }
+  }
+  encodeSample();
+}
+
+void ShadowMaskWriter::beginSample(const tm_r &tm, double height) {
+  if (!chunk.minutes.empty() &&
+      (chunk.height != height || dateKey(chunk.date) != dateKey(tm) ||
+       chunk.minutes.size() == 24 * 60)) {
+    flush();
+  }
+  if (chunk.minutes.empty()) {
+    chunk.height = height;
+    chunk.date = tm;
+    std::fill(previous.begin(), previous.end(), 0);
+  }
+  chunk.minutes.push_back(tm.hour * 60 + tm.min);
+  std::fill(current.begin(), current.end(), 0);
+}
+
+void ShadowMaskWriter::encodeSample() {
+  // XOR with the previous mask, then zero runs and literal words
+  size_t n = current.size();
+  for (size_t pos = 0; pos < n;) {
+    size_t zeros = 0;
+    while (pos + zeros < n && current[pos + zeros] == previous[pos + zeros]) {
+      zeros++;
+    }
+    appendVarint(chunk.payload, zeros);
+    pos += zeros;
+    if (pos < n) {
+      append(chunk.payload, current[pos] ^ previous[pos]);
+      pos++;
+    }
+  }
+  std::swap(previous, current);
+}
+
+void ShadowMaskWriter::flush() {
+  if (chunk.minutes.empty()) {
+    return;
+  }
+  IndexEntry entry{chunk.height,
+                   chunk.date.year,
+                   chunk.date.month,
+                   chunk.date.day,
+                   (uint32_t)chunk.minutes.size(),
+                   (uint64_t)out.tellp()};
+  index.push_back(entry);
+  put<uint32_t>(out, entry.samples);
+  std::vector<uint8_t> minutes; // as increments, one byte for regular steps
+  for (size_t k = 0; k < chunk.minutes.size(); k++) {
+    appendVarint(minutes,
+                 chunk.minutes[k] - (k > 0 ? chunk.minutes[k - 1] : 0));
+  }
+  put<uint64_t>(out, minutes.size());
+  out.write(reinterpret_cast<const char *>(minutes.data()), minutes.size());
+  put<uint64_t>(out, chunk.payload.size());
+  out.write(reinterpret_cast<const char *>(chunk.payload.data()),
+            chunk.payload.size());
+  chunk.minutes.clear();
+  chunk.payload.clear();
+}
+
+void ShadowMaskWriter::close() {
+  if (!open) {
+    return;
+  }
+  flush();
+  uint64_t indexOffset = out.tellp();
+  put<uint64_t>(out, index.size());
+  for (auto &entry : index) {
+    put(out, entry.height);
+    put(out, entry.year);
+    put(out, entry.month);
+    put(out, entry.day);
+    put(out, entry.samples);
+    put(out, entry.offset);
+  }
+  put<uint64_t>(out, indexOffset);
+  out.close();
+  open = false;
+}
+
+ShadowMaskReader::ShadowMaskReader(std::string path) : path(path) {
+  std::ifstream in(path, std::ios::binary);
+  char header[sizeof(magic)] = {};
+  in.read(header, sizeof(header));
+  if (!in || std::memcmp(header, magic, sizeof(magic)) != 0) {
+    throw std::runtime_error(path + " is not a shadow mask file");
+  }
+  nRows = get<int32_t>(in);
+  nCols = get<int32_t>(in);
+  minutesPerSample = get<int32_t>(in);
+  litThreshold = get<double>(in);
+
+  in.seekg(-(std::streamoff)sizeof(uint64_t), std::ios::end);
+  in.seekg(get<uint64_t>(in));
+  uint64_t nChunks = get<uint64_t>(in);
+  std::vector<double> chunkHeights;
+  for (uint64_t c = 0; c < nChunks && in; c++) {
+    IndexEntry entry;
+    chunkHeights.push_back(get<double>(in));
+    entry.date.year = get<int32_t>(in);
+    entry.date.month = get<int32_t>(in);
+    entry.date.day = get<int32_t>(in);
+    entry.date.hour = entry.date.min = 0;
+    entry.samples = get<uint32_t>(in);
+    entry.offset = get<uint64_t>(in);
+    index.push_back(entry);
+  }
+  if (!in) {
+    throw std::runtime_error("The index of " + path + " is damaged");
+  }
+  heightList = chunkHeights;
+  std::sort(heightList.begin(), heightList.end());
+  heightList.erase(std::unique(heightList.begin(), heightList.end()),
+                   heightList.end());
+  for (size_t c = 0; c < index.size(); c++) {
+    index[c].height =
+        std::lower_bound(heightList.begin(), heightList.end(),
+                         chunkHeights[c]) -
+        heightList.begin();
+  }
+  // chunks of a day can be written interleaved with other heights
+  std::stable_sort(index.begin(), index.end(),
+                   [](const IndexEntry &a, const IndexEntry &b) {
+                     return dateKey(a.date) < dateKey(b.date);
+                   });
+}
+
+std::vector<const ShadowMaskReader::IndexEntry *>
+ShadowMaskReader::chunksBetween(size_t height, const tm_r &from,
+                                const tm_r &to) const {
+  std::vector<const IndexEntry *> chunks;
+  for (auto &entry : index) {
+    if (entry.height == height && dateKey(entry.date) >= dateKey(from) &&
+        dateKey(entry.date) <= dateKey(to)) {
+      chunks.push_back(&entry);
+    }
+  }
+  return chunks;
+}
+
+void ShadowMaskReader::forEachMask(
+    size_t height, const tm_r &from, const tm_r &to,
+    const std::function<void(const tm_r &, const ShadowMask &)> &f) const {
+  std::ifstream in(path, std::ios::binary);
+  ShadowMask mask;
+  mask.rows = nRows;
+  mask.cols = nCols;
+  std::vector<uint16_t> minutes;
+  std::vector<uint8_t> payload;
+  for (const IndexEntry *entry : chunksBetween(height, from, to)) {
+    in.seekg(entry->offset);
+    minutes.resize(get<uint32_t>(in));
+    payload.resize(get<uint64_t>(in));
+    in.read(reinterpret_cast<char *>(payload.data()), payload.size());
+    const uint8_t *p = payload.data();
+    for (size_t k = 0; k < minutes.size(); k++) {
+      minutes[k] = (k > 0 ? minutes[k - 1] : 0) + readVarint(p);
+    }
+    payload.resize(get<uint64_t>(in));
+    in.read(reinterpret_cast<char *>(payload.data()), payload.size());
+    if (!in) {
+      throw std::runtime_error("Could not read a chunk of " + path);
+    }
+
+    mask.words.assign(wordCount(nRows, nCols), 0);
+    p = payload.data();
+    tm_r tm = entry->date;
+    for (uint16_t minute : minutes) {
+      // mirrors the encoding in ShadowMaskWriter::record
+      for (size_t pos = 0; pos < mask.words.size();) {
+        pos += readVarint(p);
+        if (pos < mask.words.size()) {
+          uint64_t word;
+          std::memcpy(&word, p, sizeof(word));
+          p += sizeof(word);
+          mask.words[pos++] ^= word;
+        }
+      }
+      tm.hour = minute / 60;
+      tm.min = minute % 60;
+      f(tm, mask);
+    }
+  }
+}
+
+Eigen::ArrayXXd ShadowMaskReader::litHours(size_t height, const tm_r &from,
+                                           const tm_r &to, int fromHour,
+                                           int toHour) const {
+  std::vector<long> count((size_t)nRows * nCols, 0);
+  forEachMask(height, from, to, [&](const tm_r &tm, const ShadowMask &mask) {
+    if (tm.hour < fromHour || tm.hour >= toHour) {
+      return;
+    }
+    for (size_t w = 0; w < mask.words.size(); w++) {
+      for (uint64_t bits = mask.words[w]; bits; bits &= bits - 1) {
+        count[w * 64 + __builtin_ctzll(bits)]++;
+      }
+    }
+  });
+  Eigen::ArrayXXd hours(nRows, nCols);
+  for (size_t k = 0; k < count.size(); k++) {
+    hours.data()[k] = count[k] * minutesPerSample / 60.0;
+  }
+  return hours;
+}
+
+Eigen::ArrayXXd ShadowMaskReader::dailyTotal(size_t height,
+                                             const tm_r &date) const {
+  return litHours(height, date, date);
+}
+
+Eigen::ArrayXXd ShadowMaskReader::averageDailyHours(size_t height,
+                                                    const tm_r &from,
+                                                    const tm_r &to,
+                                                    int fromHour,
+                                                    int toHour) const {
+  std::vector<int> days;
+  for (const IndexEntry *entry : chunksBetween(height, from, to)) {
+    days.push_back(dateKey(entry->date));
+  }
+  days.erase(std::unique(days.begin(), days.end()), days.end());
+  Eigen::ArrayXXd hours = litHours(height, from, to, fromHour, toHour);
+  return days.empty() ? hours : hours / days.size();
+}
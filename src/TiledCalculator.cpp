@@ -0,0 +1,123 @@
+#include "TiledCalculator.h"
+#include "MappedResult.h"
+#include "ShadowCalculator.h"
+#include <algorithm>
+#include <boost/format.hpp>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+TiledCalculator::TiledCalculator(const WavefrontGeometry &scene,
+                                 const Site &site, const Region &region,
+                                 size_t memoryBudget)
+    : scene(scene), site(site), region(region), memoryBudget(memoryBudget) {}
+
+size_t TiledCalculator::gridsPerCell(const RunSettings &settings) const {
+  // the same height loops as the modes
+  size_t heights = 0;
+  size_t heightsBelow = 0;
+  for (double height = 0; height <= region.maxHeight;
+       height += region.heightIncr) {
+    heights++;
+  }
+  for (double height = 0; height < region.maxHeight;
+       height += region.heightIncr) {
+    heightsBelow++;
+  }
+  size_t layers = heights;
+  if (settings.mode == Mode::monthly) {
+    layers = 12 * heights;
+  } else if (settings.mode == Mode::hourly) {
+    layers = 24 * heightsBelow;
+  } else if (settings.mode == Mode::specificmoment) {
+    layers = heightsBelow;
+  }
+  if (hasAreaSun(settings)) {
+    layers *= 2; // penumbra grids
+  }
+  // plus the grids of a single sample and the lit counts
+  return layers + 4;
+}
+
+Region TiledCalculator::tileRegion(int firstV1, int firstV2, int nV1,
+                                   int nV2) const {
+  Eigen::Vector3d step1 = (region.vector1 - region.origin) / region.stepsV1;
+  Eigen::Vector3d step2 = (region.vector2 - region.origin) / region.stepsV2;
+  Region tile = region;
+  tile.origin = region.origin + firstV1 * step1 + firstV2 * step2;
+  tile.vector1 = tile.origin + nV1 * step1;
+  tile.vector2 = tile.origin + nV2 * step2;
+  tile.stepsV1 = nV1;
+  tile.stepsV2 = nV2;
+  return tile;
+}
+
+void TiledCalculator::writeTile(std::string path, const ShadowResult &tile,
+                                int firstV1, int firstV2, bool create) const {
+  // The file is only mapped while a tile is written, so the written pages do
+  // not pile up in memory. It is created with the first tile, as the layers
+  // are only known then.
+  std::unique_ptr<MappedResult> file(
+      create ? new MappedResult(path, tile.getMode(), region.stepsV1,
+                                region.stepsV2, tile.getLayers())
+             : new MappedResult(path));
+  file->writeBlock(tile, firstV1, firstV2);
+}
+
+void TiledCalculator::run(const RunSettings &settings, std::string resultPath,
+                          std::string penumbraPath) {
+  if (settings.mode == Mode::progressive) {
+    throw std::invalid_argument(
+        "The progressive mode can not be run in tiles");
+  }
+  // every tile would stop after a different number of samples
+  if (settings.stochasticSampling) {
+    throw std::invalid_argument("Stochastic sampling can not be run in tiles");
+  }
+  size_t cells = memoryBudget / (gridsPerCell(settings) * sizeof(double));
+  if (cells < 1) {
+    throw std::invalid_argument(
+        "The memory budget is too small for a single cell");
+  }
+  // Tiles span whole columns when possible, a tile then is one contiguous
+  // range of every layer in the result file
+  tileV1 = std::min<size_t>(region.stepsV1, cells);
+  tileV2 = std::min<size_t>(region.stepsV2, cells / tileV1);
+  int tilesV1 = (region.stepsV1 + tileV1 - 1) / tileV1;
+  int tilesV2 = (region.stepsV2 + tileV2 - 1) / tileV2;
+  nTiles = tilesV1 * tilesV2;
+  raysTraced = 0;
+
+  SunEnvelope envelope = OccluderPruner::sunEnvelope(site, settings);
+  RunSettings tileSettings = settings;
+  tileSettings.showProgress = false;
+  for (int t = 0; t < nTiles; t++) {
+    int firstV1 = (t / tilesV2) * tileV1;
+    int firstV2 = (t % tilesV2) * tileV2;
+    int nV1 = std::min(tileV1, region.stepsV1 - firstV1);
+    int nV2 = std::min(tileV2, region.stepsV2 - firstV2);
+    if (settings.showProgress) {
+      std::cout << boost::format("\rtile %d of %d") % (t + 1) % nTiles
+                << std::flush;
+    }
+
+    PruneReport report;
+    WavefrontGeometry tileScene =
+        OccluderPruner(tileRegion(firstV1, firstV2, nV1, nV2), envelope)
+            .prune(scene, report);
+    ShadowCalculator calculator(tileScene, site, region);
+    calculator.setWindow(firstV1, firstV2, nV1, nV2);
+    ShadowResult tile = calculator.run(tileSettings);
+    raysTraced += calculator.getRaysTraced();
+
+    writeTile(resultPath, tile, firstV1, firstV2, t == 0);
+    const ShadowResult &tilePenumbra = calculator.getPenumbraFraction();
+    if (!penumbraPath.empty() && tilePenumbra.layerCount() > 0) {
+      writeTile(penumbraPath, tilePenumbra, firstV1, firstV2, t == 0);
+    }
+  }
+  if (settings.showProgress) {
+    std::cout << std::endl;
+  }
+}
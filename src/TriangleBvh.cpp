@@ -0,0 +1,126 @@
+#include "TriangleBvh.h"
+#include <numeric>
+
+namespace {
+const int leafSize = 4;
+}
+
+TriangleBvh::TriangleBvh(std::vector<Triangle> triangles,
+                         std::vector<double> transmittance)
+    : triangles(std::move(triangles)),
+      transmittance(std::move(transmittance)) {
+  std::vector<Eigen::Vector3d> centroids;
+  centroids.reserve(this->triangles.size());
+  for (auto &tri : this->triangles) {
+    centroids.push_back(tri.v1 + (tri.edge1 + tri.edge2) / 3.0);
+  }
+  nodes.reserve(2 * this->triangles.size() / leafSize + 1);
+  nodes.emplace_back();
+  build(0, 0, this->triangles.size(), centroids);
+}
+
+void TriangleBvh::build(int node, int first, int count,
+                        std::vector<Eigen::Vector3d> &centroids) {
+  Eigen::AlignedBox3d box;
+  Eigen::AlignedBox3d centroidBox;
+  for (int t = first; t < first + count; t++) {
+    box.extend(triangles[t].v1);
+    box.extend(triangles[t].v1 + triangles[t].edge1);
+    box.extend(triangles[t].v1 + triangles[t].edge2);
+    centroidBox.extend(centroids[t]);
+  }
+  // pad the box so that flat geometry keeps a volume
+  box.min().array() -= raytests::eps;
+  box.max().array() += raytests::eps;
+  nodes[node].box = box;
+  nodes[node].first = first;
+  nodes[node].count = count;
+  if (count <= leafSize) {
+    return;
+  }
+
+  // median split along the longest axis of the centroids
+  int axis;
+  centroidBox.diagonal().maxCoeff(&axis);
+  std::vector<int> order(count);
+  std::iota(order.begin(), order.end(), first);
+  int half = count / 2;
+  std::nth_element(order.begin(), order.begin() + half, order.end(),
+                   [&centroids, axis](int a, int b) {
+                     return centroids[a][axis] < centroids[b][axis];
+                   });
+  std::vector<Triangle> sortedTriangles(count);
+  std::vector<double> sortedTransmittance(count);
+  std::vector<Eigen::Vector3d> sortedCentroids(count);
+  for (int k = 0; k < count; k++) {
+    sortedTriangles[k] = triangles[order[k]];
+    sortedTransmittance[k] = transmittance[order[k]];
+    sortedCentroids[k] = centroids[order[k]];
+  }
+  std::copy(sortedTriangles.begin(), sortedTriangles.end(),
+            triangles.begin() + first);
+  std::copy(sortedTransmittance.begin(), sortedTransmittance.end(),
+            transmittance.begin() + first);
+  std::copy(sortedCentroids.begin(), sortedCentroids.end(),
+            centroids.begin() + first);
+
+  int child = nodes.size();
+  nodes[node].child = child;
+  nodes.emplace_back();
+  nodes.emplace_back();
+  build(child, first, half, centroids);
+  build(child + 1, first + half, count - half, centroids);
+}
+
+void TriangleBvh::trace(const Eigen::Vector3d &rayOrigin,
+                        const Eigen::Vector3d &direction,
+                        double &light) const {
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0 && light > 0.0) {
+    const Node &node = nodes[stack[--top]];
+    if (!raytests::rayHitsBox(rayOrigin, direction, node.box)) {
+      continue;
+    }
+    if (node.child >= 0) {
+      stack[top++] = node.child;
+      stack[top++] = node.child + 1;
+      continue;
+    }
+    for (int t = node.first; t < node.first + node.count; t++) {
+      if (transmittance[t] < light &&
+          raytests::rayTriangleIntersect(rayOrigin, direction, triangles[t])) {
+        light = transmittance[t];
+      }
+    }
+  }
+}
+
+void TriangleBvh::tracePacket(const Eigen::Vector3d &rayOrigin,
+                              const Eigen::Vector3d *directions,
+                              size_t nRays, double *light) const {
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    const Node &node = nodes[stack[--top]];
+    bool visit = false;
+    for (size_t r = 0; r < nRays && !visit; r++) {
+      visit = light[r] > 0.0 &&
+              raytests::rayHitsBox(rayOrigin, directions[r], node.box);
+    }
+    if (!visit) {
+      continue;
+    }
+    if (node.child >= 0) {
+      stack[top++] = node.child;
+      stack[top++] = node.child + 1;
+      continue;
+    }
+    for (int t = node.first; t < node.first + node.count; t++) {
+      raytests::packetTriangleIntersect(rayOrigin, directions, nRays,
+                                        triangles[t], transmittance[t], light);
+    }
+  }
+}
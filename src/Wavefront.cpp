@@ -5,13 +5,32 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
+
+namespace {
+// Reads the rest of the line as numbers, false if a token is not a number
+bool readNumbers(std::istringstream &iss, std::vector<double> &numbers) {
+  std::string token;
+  while (iss >> token) {
+    size_t used = 0;
+    try {
+      numbers.push_back(std::stod(token, &used));
+    } catch (std::exception &) {
+      return false;
+    }
+    if (used != token.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
 
 WavefrontGeometry::WavefrontGeometry(std::string filepath) {
   // Check for file type
   if (filepath.substr(filepath.find_last_of('.')) != ".obj") {
-    std::cout << "File: " << filepath << "\nis not a wavefront .obj file.\n";
-    std::cout << "Terminating program execution\n";
-    exit(EXIT_FAILURE);
+    throw std::runtime_error("File: " + filepath +
+                             " is not a wavefront .obj file.");
   }
 
   std::ifstream file(filepath);
@@ -80,14 +99,12 @@ WavefrontGeometry::WavefrontGeometry(std::string filepath) {
                 std::stod(parts[9]);
             tempObj.pushFace(tempFace);
           } else { // 'higher order' shapes such as pentagons etc.
-            std::cout
-                << "Wavefront parser can not parse faces with more than 4 "
-                   "vertices.\n"
-                << "Please use other software to triangulate the faces first\n"
-                << "e.g. in Blender in edit mode press 'Face -> Triangulate "
-                   "Faces' (Ctrl T) \n"
-                << "Terminating program for now.\n";
-            exit(EXIT_FAILURE);
+            throw std::runtime_error(
+                "Wavefront parser can not parse faces with more than 4 "
+                "vertices.\n"
+                "Please use other software to triangulate the faces first\n"
+                "e.g. in Blender in edit mode press 'Face -> Triangulate "
+                "Faces' (Ctrl T)");
           }
 
         } else if (stringtools::firstToken(line) == "usemtl") {
@@ -100,23 +117,129 @@ WavefrontGeometry::WavefrontGeometry(std::string filepath) {
       }
     }
     objects.push_back(tempObj); // push back last geometry
+
+    std::string instanceFile =
+        filepath.substr(0, filepath.find_last_of('.')) + ".inst";
+    if (std::ifstream(instanceFile).good()) {
+      loadInstances(instanceFile);
+    }
     std::cout << "Done loading geometry.\n\n";
 
   } else {
-    std::cout << "Was unable to open wavefront (.obj) file: " << filepath
-              << std::endl;
-    std::cout << "Terminating program.\n";
-    exit(EXIT_FAILURE);
+    throw std::runtime_error("Was unable to open wavefront (.obj) file: " +
+                             filepath);
+  }
+}
+
+bool WavefrontGeometry::definePrototype(
+    std::string name, const std::vector<std::string> &objectNames) {
+  WavefrontPrototype prototype{name, {}};
+  for (auto &objectName : objectNames) {
+    size_t k = 0;
+    while (k < objects.size() && objects[k].getName() != objectName) {
+      k++;
+    }
+    if (k == objects.size()) {
+      return false;
+    }
+    prototype.objects.push_back(k);
+  }
+  prototypeObject.resize(objects.size(), false);
+  for (size_t k : prototype.objects) {
+    prototypeObject[k] = true;
+  }
+  prototypes.push_back(prototype);
+  return true;
+}
+
+bool WavefrontGeometry::addInstance(std::string name,
+                                    const Eigen::Affine3d &transform) {
+  size_t p = 0;
+  while (p < prototypes.size() && prototypes[p].name != name) {
+    p++;
+  }
+  if (p == prototypes.size() && !definePrototype(name, {name})) {
+    return false;
+  }
+  instances.push_back({p, transform});
+  return true;
+}
+
+// Sidecar format, one statement per line:
+//   prototype <name> <object> [<object> ...]
+//   instance <prototype or object> <tx> <ty> <tz> [<rotZ deg> [<scale>]]
+//   matrix <prototype or object> <3x4 matrix, row major>
+void WavefrontGeometry::loadInstances(std::string filepath) {
+  std::ifstream file(filepath);
+  std::cout << "Loading instances from: " << filepath << std::endl;
+  std::string line;
+  std::string keyword, name;
+  int lineNumber = 0;
+  auto fail = [&](std::string reason) {
+    throw std::runtime_error(reason + " on line " +
+                             std::to_string(lineNumber) + " of " + filepath +
+                             ":\n" + line);
+  };
+  while (std::getline(file, line)) {
+    lineNumber++;
+    std::istringstream iss(line);
+    if (line.empty() || line[0] == '#' || !(iss >> keyword)) {
+      continue;
+    }
+    if (!(iss >> name)) {
+      fail("Missing name");
+    }
+    bool ok = true;
+    if (keyword == "prototype") {
+      std::vector<std::string> objectNames;
+      std::string objectName;
+      while (iss >> objectName) {
+        objectNames.push_back(objectName);
+      }
+      if (objectNames.empty()) {
+        fail("Prototype without objects");
+      }
+      ok = definePrototype(name, objectNames);
+    } else if (keyword == "instance") {
+      std::vector<double> numbers;
+      if (!readNumbers(iss, numbers) || numbers.size() < 3 ||
+          numbers.size() > 5) {
+        fail("Expected a translation and an optional rotation and scale");
+      }
+      double rotation = numbers.size() > 3 ? numbers[3] : 0.0;
+      double scale = numbers.size() > 4 ? numbers[4] : 1.0;
+      Eigen::Affine3d transform =
+          Eigen::Translation3d(numbers[0], numbers[1], numbers[2]) *
+          Eigen::AngleAxisd(rotation * M_PI / 180.0,
+                            Eigen::Vector3d::UnitZ()) *
+          Eigen::Scaling(scale);
+      ok = addInstance(name, transform);
+    } else if (keyword == "matrix") {
+      std::vector<double> numbers;
+      if (!readNumbers(iss, numbers) || numbers.size() != 12) {
+        fail("Expected the 12 numbers of a 3x4 matrix");
+      }
+      Eigen::Affine3d transform = Eigen::Affine3d::Identity();
+      for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 4; c++) {
+          transform.matrix()(r, c) = numbers[4 * r + c];
+        }
+      }
+      ok = addInstance(name, transform);
+    } else {
+      fail("Unknown keyword " + keyword);
+    }
+    if (!ok) {
+      fail("Unknown object or prototype");
+    }
   }
 }
 
 void WavefrontMatLib::loadMaterialLibrary(std::string filepath) {
   // Check for file type
   if (filepath.substr(filepath.find_last_of('.')) != ".mtl") {
-    std::cout << "File: " << filepath
-              << "\n is not a wavefront material (.mtl) file.\n"
-              << "Terminating program execution\n";
-    exit(EXIT_FAILURE);
+    throw std::runtime_error("File: " + filepath +
+                             " is not a wavefront material (.mtl) file.");
   }
 
   std::ifstream file(filepath);
@@ -169,9 +292,7 @@ void WavefrontMatLib::loadMaterialLibrary(std::string filepath) {
     }
 
   } else {
-    std::cout << "Was unable to open wavefront materials (.mtl) file: "
-              << filepath << std::endl;
-    std::cout << "Terminating program.\n";
-    exit(EXIT_FAILURE);
+    throw std::runtime_error(
+        "Was unable to open wavefront materials (.mtl) file: " + filepath);
   }
 }
@@ -10,10 +10,110 @@
 #include <string>
 #include "tm_r.h"
 #include "ShadowCalculator.h"
+#include "OptionReader.h"
+#include "ResultWriter.h"
+#include "OccluderPruner.h"
+#include "ShadowMaskStore.h"
+#include "TiledCalculator.h"
+#include "ReceiverSampler.h"
+#include <memory>
 #include <chrono>
 
 
-void setupAndRun(int ac, char *av[]) {
+void runInMemory(const WavefrontGeometry &geometry, const Site &site,
+                 const Region &region, const RunSettings &settings,
+                 ResultWriter &writer, bool writeMasks,
+                 const ReceiverSampler *receivers) {
+  ShadowCalculator shadowCalc(geometry, site, region);
+  if (receivers) {
+    shadowCalc.setReceivers(receivers->getPoints());
+  }
+  // the progressive mode writes its estimate after every pass
+  shadowCalc.setUpdateCallback([&writer](const ProgressiveUpdate &update) {
+    writer.writeProgressiveUpdate(update);
+    std::cout << boost::format("pass %2d: stride %3d, %7d samples, max error "
+                               "%6.3f h, %7.2f s\n") %
+                     update.pass % update.stride % update.samples %
+                     update.maxError % update.elapsed
+              << std::flush;
+  });
+  // optionally keep the lit/shaded state of every time sample
+  std::unique_ptr<ShadowMaskWriter> masks;
+  if (writeMasks) {
+    if (sampleMinutes(settings.mode) == 0 || settings.stochasticSampling) {
+      std::cout << "Shadow masks are only written for evenly spaced time "
+                   "samples.\n";
+    } else {
+      masks.reset(new ShadowMaskWriter(
+          writer.modeFilePath(settings.mode, "shadow_masks.gsm"),
+          region.stepsV1, region.stepsV2, sampleMinutes(settings.mode)));
+      shadowCalc.setSampleCallback(
+          [&masks](const tm_r &tm, double height, const Eigen::ArrayXXd &light) {
+            masks->record(tm, height, light);
+          });
+      shadowCalc.setVisibilityCallback(
+          [&masks](const tm_r &tm, double height, const BitGrid &lit) {
+            masks->record(tm, height, lit);
+          });
+    }
+  }
+  ShadowResult result = shadowCalc.run(settings);
+  masks.reset();
+
+  if (receivers) {
+    writer.writeReceivers(result, *receivers);
+    if (shadowCalc.getPenumbraFraction().layerCount() > 0) {
+      writer.writeReceivers(shadowCalc.getPenumbraFraction(), *receivers,
+                            "penumbra_");
+    }
+  } else if (settings.mode != Mode::progressive) {
+    writer.write(result);
+    if (hasAreaSun(settings)) {
+      writer.write(shadowCalc.getPenumbraFraction(), "penumbra_");
+    }
+  }
+  if (!shadowCalc.getSamplingSummary().empty()) {
+    writer.writeSamplingSummary(shadowCalc.getSamplingError(),
+                                shadowCalc.getSamplingSummary());
+    for (auto &layer : shadowCalc.getSamplingSummary()) {
+      const ResultLayer &info = result.getLayers()[layer.layer];
+      std::string period =
+          settings.mode == Mode::monthly
+              ? (boost::format("month %2d") % info.time.month).str()
+              : modeName(settings.mode);
+      std::cout << boost::format("%s, height %5.2f: %7d samples, max "
+                                 "error %6.3f h%s\n") %
+                       period % info.height % layer.samples %
+                       layer.maxError %
+                       (layer.converged ? "" : " (sample limit reached)");
+    }
+  }
+}
+
+// The region is computed tile by tile into memory mapped result files, the
+// text output is written from those files
+void runInTiles(const WavefrontGeometry &geometry, const Site &site,
+                const Region &region, const RunSettings &settings,
+                ResultWriter &writer, size_t memoryBudget) {
+  std::string resultPath = writer.modeFilePath(settings.mode, "result.gsr");
+  std::string penumbraPath =
+      hasAreaSun(settings)
+          ? writer.modeFilePath(settings.mode, "penumbra.gsr")
+          : "";
+  TiledCalculator tiles(geometry, site, region, memoryBudget);
+  tiles.run(settings, resultPath, penumbraPath);
+  std::cout << "Computed " << tiles.getTileCount() << " tiles of "
+            << tiles.getTileV1() << " x " << tiles.getTileV2() << " cells.\n";
+
+  writer.write(MappedResult(resultPath));
+  if (!penumbraPath.empty()) {
+    writer.write(MappedResult(penumbraPath), "penumbra_");
+  }
+}
+
+// The library throws on bad input and on files it can not read or write, the
+// whole run is one try block so that this is reported in one place
+void setupAndRun(int ac, char *av[]) try {
   // First we parse the command line arguments
   std::string optionFile;
   try {
@@ -55,34 +155,90 @@ void setupAndRun(int ac, char *av[]) {
   read_xml(optionFile, pt);
   options = pt.get_child("options");
 
+  RunSettings settings;
+  try {
+    settings = optionreader::readRunSettings(options);
+  } catch (std::invalid_argument &e) {
+    std::cout << e.what() << "\n";
+    return;
+  }
+  settings.showProgress = true;
+
   // Load the geometry
   WavefrontGeometry geometry(options.get<std::string>("geometryFile"));
-  // Initialize the sun
-  SunTracker sun(options.get<double>("latitude"),
-                 options.get<double>("longitude"),
-                 options.get<double>("timezone"));
-  sun.setRelativeRotationAroundZ(options.get<double>("geometryRotation"));
+  Site site = optionreader::readSite(options);
+  Region region = optionreader::readRegion(options);
 
-  // Initialize the ShadowCalculator
-  ShadowCalculator shadowCalc(geometry.getObjects(), geometry.getVertices(), sun, options);
+  // Points on receiver objects replace the cells of the region, they are
+  // sampled before pruning so the face numbers are those of the .obj file
+  std::unique_ptr<ReceiverSampler> receivers;
+  std::vector<std::string> receiverNames = optionreader::readReceivers(options);
+  if (!receiverNames.empty()) {
+    receivers.reset(new ReceiverSampler(
+        geometry, receiverNames, options.get<double>("receiverDensity", 100.0),
+        options.get<bool>("flipReceiverNormals", false)));
+    if (receivers->getPoints().empty()) {
+      std::cout << "No points on the receivers, check the names and the "
+                   "density.\n";
+      exit(EXIT_FAILURE);
+    }
+    std::cout << "Sampled " << receivers->getPoints().size() << " points on "
+              << receivers->getReceiverFaces() << " receiver faces.\n";
+    region = receivers->boundingRegion();
+  }
 
+  // Drop the geometry that can not shadow the region during this run
+  if (options.get<bool>("pruneOccluders", true)) {
+    OccluderPruner pruner(region, OccluderPruner::sunEnvelope(site, settings));
+    PruneReport report;
+    geometry = pruner.prune(geometry, report);
+    std::cout << "Pruned occluders: " << report.summary() << "\n";
+  }
 
   // Execute the mode of the options
-  auto start = std::chrono::steady_clock::now();
-  if(options.get<std::string>("mode") == "growseason"){
+  switch (settings.mode) {
+  case Mode::growseason:
     std::cout << "Computing average daily sun exposure over the growseason.\n";
-    shadowCalc.growSeasonAverage();
-  } else if (options.get<std::string>("mode") == "specificmoment"){
+    break;
+  case Mode::specificmoment:
     std::cout << "Computing sun exposure at a specific moment.\n";
-    shadowCalc.specificMoment();
-  } else if (options.get<std::string>("mode") == "monthly"){
+    break;
+  case Mode::monthly:
     std::cout << "Computing average daily sun exposure for every month.\n";
-    shadowCalc.monthly();
-  } else if (options.get<std::string>("mode") == "hourly"){
+    break;
+  case Mode::hourly:
     std::cout << "Computing average sun exposure for every hour.\n";
-    shadowCalc.hourly();
+    break;
+  case Mode::progressive:
+    std::cout << "Progressively refining the growseason average.\n";
+    break;
+  }
+  ResultWriter writer(options.get<std::string>("outputPath"));
+  bool writeMasks = options.get<bool>("writeShadowMasks", false);
+  // memoryBudget is given in MB, 0 keeps the whole region in memory
+  size_t memoryBudget = options.get<double>("memoryBudget", 0.0) * 1048576.0;
+  if (memoryBudget > 0 && settings.mode == Mode::progressive) {
+    std::cout << "The memory budget is not used in progressive mode.\n";
+    memoryBudget = 0;
+  }
+  if (memoryBudget > 0 && settings.stochasticSampling) {
+    std::cout << "The memory budget is not used with stochastic sampling.\n";
+    memoryBudget = 0;
+  }
+  if (memoryBudget > 0 && receivers) {
+    std::cout << "The memory budget is not used for receivers.\n";
+    memoryBudget = 0;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  if (memoryBudget > 0) {
+    runInTiles(geometry, site, region, settings, writer, memoryBudget);
+    if (writeMasks) {
+      std::cout << "Shadow masks are not written for tiled runs.\n";
+    }
   } else {
-    std::cout << options.get<std::string>("mode") << " is not a valid mode.\n";
+    runInMemory(geometry, site, region, settings, writer, writeMasks,
+                receivers.get());
   }
   auto end = std::chrono::steady_clock::now();
 
@@ -91,6 +247,9 @@ void setupAndRun(int ac, char *av[]) {
   std::cout << "Garden sun calculator is done.\n";
   std::cout << "The computation took " << duration.count() << "s\n";
   std::cout << "Results can be found in: " << options.get<std::string>("outputPath") << std::endl;
+} catch (std::exception &e) {
+  std::cout << e.what() << "\n";
+  exit(EXIT_FAILURE);
 }
 
 int main(int ac, char *av[]) {
@@ -0,0 +1,60 @@
+#include "SceneGenerator.h"
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <string>
+
+// Command line front end for SceneGenerator, writes an .obj/.mtl pair
+int main(int ac, char *av[]) {
+  long triangles;
+  unsigned seed;
+  int canopySegments;
+  bool instanced;
+  std::string output;
+  try {
+    boost::program_options::options_description desc("Possible options");
+    desc.add_options()("help,h", "produce help message")(
+        "triangles,n",
+        boost::program_options::value<long>(&triangles)->default_value(1000),
+        "approximate number of triangles in the scene")(
+        "output,o",
+        boost::program_options::value<std::string>(&output)->default_value(
+            "generated.obj"),
+        "path of the .obj file, the .mtl is written next to it")(
+        "seed,s",
+        boost::program_options::value<unsigned>(&seed)->default_value(1),
+        "random seed for the layout")(
+        "canopy-segments",
+        boost::program_options::value<int>(&canopySegments)->default_value(0),
+        "tessellation of the tree canopies, 0 picks it from the scene size")(
+        "instanced", "write the balconies as instances of one prototype");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store(
+        boost::program_options::parse_command_line(ac, av, desc), vm);
+    boost::program_options::notify(vm);
+
+    instanced = vm.count("instanced") > 0;
+    if (vm.count("help")) {
+      std::cout << "General usage: " << av[0]
+                << " -n <triangles> -o <path/to/scene.obj>\n";
+      std::cout << desc << "\n";
+      return 0;
+    }
+  } catch (std::exception &e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  SceneGenerator generator(triangles, seed, canopySegments, instanced);
+  generator.writeObj(output);
+
+  Region region = SceneGenerator::suggestedRegion();
+  std::cout << "Wrote " << generator.triangleCount() << " triangles in "
+            << generator.getObjects().size() << " objects to " << output
+            << "\n";
+  std::cout << "Region of the study balcony:\n"
+            << "  <regionO>" << region.origin.transpose() << "</regionO>\n"
+            << "  <regionV1>" << region.vector1.transpose() << "</regionV1>\n"
+            << "  <regionV2>" << region.vector2.transpose() << "</regionV2>\n";
+  return 0;
+}
@@ -0,0 +1,133 @@
+#include "SceneGenerator.h"
+#include "ShadowCalculator.h"
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Runs the calculator modes on generated scenes of increasing size with
+// different thread counts and reports the throughput in rays per second.
+
+namespace {
+template <class T>
+std::vector<T> parseList(const std::string &list) {
+  std::vector<std::string> parts;
+  std::vector<T> values;
+  boost::split(parts, list, boost::is_any_of(","));
+  for (auto &part : parts) {
+    if (!part.empty()) {
+      values.push_back((T)std::stod(part));
+    }
+  }
+  return values;
+}
+} // namespace
+
+int main(int ac, char *av[]) {
+  std::string sizeList, threadList, modeList, csvFile;
+  int stepsV1, stepsV2;
+  bool instanced;
+  try {
+    boost::program_options::options_description desc("Possible options");
+    desc.add_options()("help,h", "produce help message")(
+        "sizes",
+        boost::program_options::value<std::string>(&sizeList)->default_value(
+            "1000,10000,100000"),
+        "comma separated scene sizes in triangles (up to 10000000)")(
+        "threads",
+        boost::program_options::value<std::string>(&threadList)
+            ->default_value("1"),
+        "comma separated thread counts")(
+        "modes",
+        boost::program_options::value<std::string>(&modeList)->default_value(
+            "specificmoment,hourly"),
+        "comma separated modes, 'all' runs every mode")(
+        "stepsV1",
+        boost::program_options::value<int>(&stepsV1)->default_value(26),
+        "grid resolution in V1 direction")(
+        "stepsV2",
+        boost::program_options::value<int>(&stepsV2)->default_value(77),
+        "grid resolution in V2 direction")(
+        "csv", boost::program_options::value<std::string>(&csvFile),
+        "also write the results to this csv file")(
+        "instanced", "place the balconies as instances of one prototype");
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store(
+        boost::program_options::parse_command_line(ac, av, desc), vm);
+    boost::program_options::notify(vm);
+
+    instanced = vm.count("instanced") > 0;
+    if (vm.count("help")) {
+      std::cout << desc << "\n";
+      return 0;
+    }
+  } catch (std::exception &e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  if (modeList == "all") {
+    modeList = "specificmoment,hourly,growseason,monthly";
+  }
+  std::vector<Mode> modes;
+  std::vector<std::string> modeNames;
+  boost::split(modeNames, modeList, boost::is_any_of(","));
+  for (auto &name : modeNames) {
+    Mode mode;
+    if (!parseMode(name, mode)) {
+      std::cerr << name << " is not a valid mode.\n";
+      return EXIT_FAILURE;
+    }
+    modes.push_back(mode);
+  }
+
+  Site site{51.463839, 5.474531, 2.0, 0.0};
+  Region region = SceneGenerator::suggestedRegion();
+  region.stepsV1 = stepsV1;
+  region.stepsV2 = stepsV2;
+  RunSettings settings;
+  settings.date = tm_r{2020, 6, 21, 12, 0};
+
+  std::ofstream csv;
+  if (!csvFile.empty()) {
+    csv.open(csvFile);
+    csv << "mode,triangles,threads,seconds,rays,rays_per_second\n";
+  }
+  std::cout << boost::format("%-15s %10s %8s %10s %14s %14s\n") % "mode" %
+                   "triangles" % "threads" % "seconds" % "rays" % "rays/s";
+
+  for (long size : parseList<long>(sizeList)) {
+    SceneGenerator generator(size, 1, 0, instanced);
+    WavefrontGeometry scene = generator.toGeometry();
+    for (Mode mode : modes) {
+      for (int threads : parseList<int>(threadList)) {
+        ShadowCalculator calculator(scene, site, region);
+        settings.mode = mode;
+        settings.nThreads = threads;
+
+        auto start = std::chrono::steady_clock::now();
+        calculator.run(settings);
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        long long rays = calculator.getRaysTraced();
+        double throughput = seconds > 0.0 ? rays / seconds : 0.0;
+        std::cout << boost::format("%-15s %10d %8d %10.3f %14d %14.4g\n") %
+                         modeName(mode) % generator.triangleCount() % threads %
+                         seconds % rays % throughput
+                  << std::flush;
+        if (csv.is_open()) {
+          csv << modeName(mode) << "," << generator.triangleCount() << ","
+              << threads << "," << seconds << "," << rays << "," << throughput
+              << "\n";
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,350 @@
+#include "SceneGenerator.h"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace {
+const double lotSpacing = 32.0;
+const double floorHeight = 3.0;
+const double groundLevel = -floorHeight; // the study balcony is on floor 1
+const double bayWidth = 4.0;
+const double balconyDepth = 1.33;
+const double railingHeight = 1.1;
+const double railingThickness = 0.05;
+const double slabThickness = 0.2;
+} // namespace
+
+SceneGenerator::SceneGenerator(long targetTriangles, unsigned seed,
+                               int canopySegments, bool instanced)
+    : canopySegments(canopySegments), instanced(instanced), rng(seed) {
+  if (this->canopySegments <= 0) {
+    if (targetTriangles < 100000) {
+      this->canopySegments = 8;
+    } else if (targetTriangles < 1000000) {
+      this->canopySegments = 16;
+    } else {
+      this->canopySegments = 32;
+    }
+  }
+
+  if (instanced) {
+    addBalconyPrototypes();
+  }
+  int ring = 0;
+  addBlock(Eigen::Vector2d(0.0, 0.0), true);
+  while (nTriangles < targetTriangles - 2) {
+    ring++;
+    for (int i = -ring; i <= ring && nTriangles < targetTriangles - 2; i++) {
+      for (int j = -ring; j <= ring && nTriangles < targetTriangles - 2; j++) {
+        if (std::max(std::abs(i), std::abs(j)) != ring) {
+          continue; // lot belongs to an inner ring
+        }
+        Eigen::Vector2d lotCenter(i * lotSpacing, j * lotSpacing);
+        if (uniform(0.0, 1.0) < 0.35) {
+          addTrees(lotCenter);
+        } else {
+          addBlock(lotCenter, false);
+        }
+      }
+    }
+  }
+  addGround((ring + 1) * lotSpacing);
+}
+
+const std::map<std::string, double> &SceneGenerator::materialOpacities() {
+  static const std::map<std::string, double> opacities{
+      {"Concrete", 1.0}, {"Metal", 1.0}, {"Glass", 0.1},
+      {"Bark", 1.0},     {"Foliage", 0.6}, {"Ground", 1.0}};
+  return opacities;
+}
+
+Region SceneGenerator::suggestedRegion() {
+  Region region;
+  region.origin << -1.92, 0.665, 0.0;
+  region.vector1 << -1.92, -0.665, 0.0;
+  region.vector2 << 1.92, 0.665, 0.0;
+  region.stepsV1 = 26;
+  region.stepsV2 = 77;
+  region.maxHeight = 0.5;
+  region.heightIncr = 0.25;
+  return region;
+}
+
+double SceneGenerator::uniform(double min, double max) {
+  return std::uniform_real_distribution<double>(min, max)(rng);
+}
+
+void SceneGenerator::pushObject(GeneratedObject &&obj) {
+  if (obj.triangles.empty()) {
+    return;
+  }
+  nTriangles += obj.triangles.size();
+  objects.push_back(std::move(obj));
+}
+
+void SceneGenerator::addBlock(Eigen::Vector2d lotCenter, bool originLot) {
+  // The facade with the balconies faces -y and lies at y = facadeY
+  int bays = 3 + (int)uniform(0.0, 4.0);
+  int floors = originLot ? 4 : 3 + (int)uniform(0.0, 10.0);
+  if (originLot && bays % 2 == 0) {
+    bays++; // odd number of bays puts the middle balcony at x = 0
+  }
+  double width = bays * bayWidth;
+  double facadeY = originLot ? 0.665 : lotCenter.y() + uniform(-4.0, 4.0);
+  double depth = uniform(10.0, 14.0);
+  double x0 = lotCenter.x() - width / 2;
+  double top = groundLevel + floors * floorHeight;
+
+  std::string id = std::to_string(objects.size());
+  GeneratedObject concrete{"Block_" + id, "Concrete", {}, {}};
+  GeneratedObject railing{"Railing_" + id, uniform(0.0, 1.0) < 0.4 ? "Glass"
+                                                                    : "Metal",
+                          {}, {}};
+
+  addBox(concrete, Eigen::Vector3d(x0, facadeY, groundLevel),
+         Eigen::Vector3d(x0 + width, facadeY + depth, top));
+  for (int floor = 1; floor < floors; floor++) {
+    double z = groundLevel + floor * floorHeight;
+    for (int bay = 0; bay < bays; bay++) {
+      double xCenter = x0 + (bay + 0.5) * bayWidth;
+      if (instanced) {
+        instances.push_back({"balcony_" + railing.material,
+                             Eigen::Vector3d(xCenter, facadeY, z)});
+        nTriangles += balconyTriangles;
+      } else {
+        addBalcony(concrete, railing, Eigen::Vector3d(xCenter, facadeY, z));
+      }
+    }
+  }
+  pushObject(std::move(concrete));
+  pushObject(std::move(railing));
+}
+
+void SceneGenerator::addBalcony(GeneratedObject &slab, GeneratedObject &railing,
+                                Eigen::Vector3d anchor) {
+  // anchor is the middle of the balcony where the slab top meets the facade
+  double xmin = anchor.x() - bayWidth / 2 + 0.08;
+  double xmax = anchor.x() + bayWidth / 2 - 0.08;
+  double yFront = anchor.y() - balconyDepth;
+  double z = anchor.z();
+  addBox(slab, Eigen::Vector3d(xmin, yFront, z - slabThickness),
+         Eigen::Vector3d(xmax, anchor.y(), z));
+  // front and two side panels
+  addBox(railing, Eigen::Vector3d(xmin, yFront, z),
+         Eigen::Vector3d(xmax, yFront + railingThickness, z + railingHeight));
+  addBox(railing, Eigen::Vector3d(xmin, yFront, z),
+         Eigen::Vector3d(xmin + railingThickness, anchor.y(),
+                         z + railingHeight));
+  addBox(railing, Eigen::Vector3d(xmax - railingThickness, yFront, z),
+         Eigen::Vector3d(xmax, anchor.y(), z + railingHeight));
+}
+
+void SceneGenerator::addBalconyPrototypes() {
+  // One slab shared by both railing variants, all in the local frame of a
+  // balcony anchored at the origin
+  GeneratedObject slab{"BalconySlab", "Concrete", {}, {}};
+  GeneratedObject metal{"BalconyRailing_Metal", "Metal", {}, {}};
+  GeneratedObject glass{"BalconyRailing_Glass", "Glass", {}, {}};
+  GeneratedObject secondSlab;
+  addBalcony(slab, metal, Eigen::Vector3d::Zero());
+  addBalcony(secondSlab, glass, Eigen::Vector3d::Zero());
+  balconyTriangles = slab.triangles.size() + metal.triangles.size();
+  prototypes.push_back({"balcony_Metal", {slab.name, metal.name}});
+  prototypes.push_back({"balcony_Glass", {slab.name, glass.name}});
+  objects.push_back(std::move(slab));
+  objects.push_back(std::move(metal));
+  objects.push_back(std::move(glass));
+}
+
+void SceneGenerator::addTrees(Eigen::Vector2d lotCenter) {
+  int trees = 3 + (int)uniform(0.0, 4.0);
+  for (int t = 0; t < trees; t++) {
+    std::string id = std::to_string(objects.size());
+    Eigen::Vector3d base(lotCenter.x() + uniform(-10.0, 10.0),
+                         lotCenter.y() + uniform(-10.0, 10.0), groundLevel);
+    double trunkHeight = uniform(3.0, 8.0);
+    double crown = uniform(2.0, 5.0);
+
+    GeneratedObject trunk{"Trunk_" + id, "Bark", {}, {}};
+    addCylinder(trunk, base, 0.3, trunkHeight + crown, 8);
+    GeneratedObject canopy{"Canopy_" + id, "Foliage", {}, {}};
+    addEllipsoid(canopy,
+                 base + Eigen::Vector3d(0.0, 0.0, trunkHeight + crown * 0.8),
+                 Eigen::Vector3d(crown, crown, crown * 0.8), canopySegments);
+    pushObject(std::move(trunk));
+    pushObject(std::move(canopy));
+  }
+}
+
+void SceneGenerator::addGround(double halfSize) {
+  GeneratedObject ground{"Ground", "Ground", {}, {}};
+  ground.vertices = {Eigen::Vector3d(-halfSize, -halfSize, groundLevel),
+                     Eigen::Vector3d(halfSize, -halfSize, groundLevel),
+                     Eigen::Vector3d(halfSize, halfSize, groundLevel),
+                     Eigen::Vector3d(-halfSize, halfSize, groundLevel)};
+  ground.triangles = {Eigen::Vector3i(0, 1, 2), Eigen::Vector3i(0, 2, 3)};
+  pushObject(std::move(ground));
+}
+
+void SceneGenerator::addBox(GeneratedObject &obj, Eigen::Vector3d min,
+                            Eigen::Vector3d max) {
+  int o = obj.vertices.size();
+  for (int k = 0; k < 8; k++) {
+    obj.vertices.emplace_back((k & 1) ? max.x() : min.x(),
+                              (k & 2) ? max.y() : min.y(),
+                              (k & 4) ? max.z() : min.z());
+  }
+  const int quads[6][4] = {{0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4},
+                           {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5}};
+  for (auto &q : quads) {
+    obj.triangles.emplace_back(o + q[0], o + q[1], o + q[2]);
+    obj.triangles.emplace_back(o + q[0], o + q[2], o + q[3]);
+  }
+}
+
+void SceneGenerator::addCylinder(GeneratedObject &obj, Eigen::Vector3d base,
+                                 double radius, double height, int segments) {
+  int o = obj.vertices.size();
+  for (int s = 0; s < segments; s++) {
+    double phi = 2.0 * M_PI * s / segments;
+    Eigen::Vector3d p = base + radius * Eigen::Vector3d(std::cos(phi),
+                                                        std::sin(phi), 0.0);
+    obj.vertices.push_back(p);
+    obj.vertices.push_back(p + Eigen::Vector3d(0.0, 0.0, height));
+  }
+  for (int s = 0; s < segments; s++) {
+    int a = o + 2 * s, b = o + 2 * ((s + 1) % segments);
+    obj.triangles.emplace_back(a, b, b + 1);
+    obj.triangles.emplace_back(a, b + 1, a + 1);
+  }
+}
+
+void SceneGenerator::addEllipsoid(GeneratedObject &obj, Eigen::Vector3d center,
+                                  Eigen::Vector3d radii, int segments) {
+  // UV sphere with segments/2 rings: 2 * segments * (rings - 1) triangles
+  int rings = std::max(2, segments / 2);
+  int o = obj.vertices.size();
+  obj.vertices.push_back(center + Eigen::Vector3d(0.0, 0.0, radii.z()));
+  for (int r = 1; r < rings; r++) {
+    double theta = M_PI * r / rings;
+    for (int s = 0; s < segments; s++) {
+      double phi = 2.0 * M_PI * s / segments;
+      obj.vertices.push_back(
+          center + Eigen::Vector3d(radii.x() * std::sin(theta) * std::cos(phi),
+                                   radii.y() * std::sin(theta) * std::sin(phi),
+                                   radii.z() * std::cos(theta)));
+    }
+  }
+  obj.vertices.push_back(center - Eigen::Vector3d(0.0, 0.0, radii.z()));
+  int bottom = obj.vertices.size() - 1;
+
+  auto ringVertex = [&](int r, int s) {
+    return o + 1 + (r - 1) * segments + (s % segments);
+  };
+  for (int s = 0; s < segments; s++) {
+    obj.triangles.emplace_back(o, ringVertex(1, s), ringVertex(1, s + 1));
+    obj.triangles.emplace_back(bottom, ringVertex(rings - 1, s + 1),
+                               ringVertex(rings - 1, s));
+  }
+  for (int r = 1; r < rings - 1; r++) {
+    for (int s = 0; s < segments; s++) {
+      obj.triangles.emplace_back(ringVertex(r, s), ringVertex(r + 1, s),
+                                 ringVertex(r + 1, s + 1));
+      obj.triangles.emplace_back(ringVertex(r, s), ringVertex(r + 1, s + 1),
+                                 ringVertex(r, s + 1));
+    }
+  }
+}
+
+void SceneGenerator::writeObj(std::string objPath) const {
+  std::string base = objPath.substr(0, objPath.find_last_of('.'));
+  std::string mtlPath = base + ".mtl";
+  std::string mtlName = mtlPath.substr(mtlPath.find_last_of('/') + 1);
+
+  std::ofstream mtl(mtlPath);
+  if (!mtl.is_open()) {
+    std::cout << "Could not open output file: " << mtlPath << "\n";
+    exit(EXIT_FAILURE);
+  }
+  mtl << "# Generated by GSCSceneGenerator\n";
+  for (auto &mat : materialOpacities()) {
+    mtl << "\nnewmtl " << mat.first << "\nd " << mat.second << "\nillum 2\n";
+  }
+
+  std::ofstream obj(objPath);
+  if (!obj.is_open()) {
+    std::cout << "Could not open output file: " << objPath << "\n";
+    exit(EXIT_FAILURE);
+  }
+  obj << "# Generated by GSCSceneGenerator, " << nTriangles << " triangles\n";
+  obj << "mtllib " << mtlName << "\n";
+  // The parser expects v/vt/vn triplets, all faces share one vt and vn
+  long offset = 1;
+  for (auto &o : objects) {
+    obj << "o " << o.name << "\n";
+    for (auto &v : o.vertices) {
+      obj << "v " << v.x() << " " << v.y() << " " << v.z() << "\n";
+    }
+    if (offset == 1) {
+      obj << "vt 0 0\nvn 0 0 1\n";
+    }
+    obj << "usemtl " << o.material << "\n";
+    for (auto &t : o.triangles) {
+      obj << "f " << offset + t[0] << "/1/1 " << offset + t[1] << "/1/1 "
+          << offset + t[2] << "/1/1\n";
+    }
+    offset += o.vertices.size();
+  }
+
+  if (instances.empty()) {
+    return;
+  }
+  std::string instPath = base + ".inst";
+  std::ofstream inst(instPath);
+  if (!inst.is_open()) {
+    std::cout << "Could not open output file: " << instPath << "\n";
+    exit(EXIT_FAILURE);
+  }
+  inst << "# Generated by GSCSceneGenerator\n";
+  for (auto &prototype : prototypes) {
+    inst << "prototype " << prototype.first;
+    for (auto &name : prototype.second) {
+      inst << " " << name;
+    }
+    inst << "\n";
+  }
+  for (auto &instance : instances) {
+    inst << "instance " << instance.prototype << " "
+         << instance.translation.x() << " " << instance.translation.y() << " "
+         << instance.translation.z() << "\n";
+  }
+}
+
+WavefrontGeometry SceneGenerator::toGeometry() const {
+  std::vector<WavefrontObject> wavefrontObjects;
+  std::vector<Eigen::Vector3d> vertices;
+  Eigen::Matrix3d face;
+  for (auto &o : objects) {
+    WavefrontObject obj;
+    double offset = vertices.size() + 1;
+    obj.setObjectName(o.name);
+    obj.setMaterial(o.material);
+    obj.setOpacity(materialOpacities().at(o.material));
+    for (auto &t : o.triangles) {
+      face << offset + t[0], 1, 1, offset + t[1], 1, 1, offset + t[2], 1, 1;
+      obj.pushFace(face);
+    }
+    vertices.insert(vertices.end(), o.vertices.begin(), o.vertices.end());
+    wavefrontObjects.push_back(std::move(obj));
+  }
+  WavefrontGeometry geometry(std::move(wavefrontObjects), std::move(vertices));
+  for (auto &prototype : prototypes) {
+    geometry.definePrototype(prototype.first, prototype.second);
+  }
+  for (auto &instance : instances) {
+    geometry.addInstance(instance.prototype,
+                         Eigen::Affine3d(Eigen::Translation3d(
+                             instance.translation)));
+  }
+  return geometry;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "SimulationSetup.h"
+#include "WavefrontGeometry.h"
+#include <Eigen/Dense>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+struct GeneratedObject {
+  std::string name;
+  std::string material;
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<Eigen::Vector3i> triangles; // 0 based, local to the object
+};
+
+struct GeneratedInstance {
+  std::string prototype;
+  Eigen::Vector3d translation;
+};
+
+// Procedural neighbourhood for scaling tests. Lots on a square grid are filled
+// ring by ring around the origin with apartment blocks (balcony rows with
+// opaque or glass railings) and clusters of trees with translucent canopies
+// until the requested number of triangles is reached. The lot at the origin
+// always holds a block with a balcony floor that coincides with
+// suggestedRegion(), so the same region can be used for every scene size.
+// With instanced set the balconies are written once as prototypes and placed
+// through a .inst sidecar file, the layout is the same as without.
+class SceneGenerator {
+public:
+  // canopySegments <= 0 picks the canopy tessellation from the target size
+  SceneGenerator(long targetTriangles, unsigned seed = 1,
+                 int canopySegments = 0, bool instanced = false);
+
+  const std::vector<GeneratedObject> &getObjects() const { return objects; }
+  // Triangles in the scene, every instance counts fully
+  long triangleCount() const { return nTriangles; }
+
+  // Writes the .obj and a .mtl (and .inst) with the same base name next to it
+  void writeObj(std::string objPath) const;
+  WavefrontGeometry toGeometry() const;
+
+  static Region suggestedRegion();
+  static const std::map<std::string, double> &materialOpacities();
+
+private:
+  std::vector<GeneratedObject> objects;
+  std::vector<std::pair<std::string, std::vector<std::string>>> prototypes;
+  std::vector<GeneratedInstance> instances;
+  long nTriangles = 0;
+  long balconyTriangles = 0;
+  int canopySegments;
+  bool instanced;
+  std::mt19937 rng;
+
+  double uniform(double min, double max);
+  void addBlock(Eigen::Vector2d lotCenter, bool originLot);
+  void addBalcony(GeneratedObject &slab, GeneratedObject &railing,
+                  Eigen::Vector3d anchor);
+  void addBalconyPrototypes();
+  void addTrees(Eigen::Vector2d lotCenter);
+  void addGround(double halfSize);
+  void pushObject(GeneratedObject &&obj);
+
+  static void addBox(GeneratedObject &obj, Eigen::Vector3d min,
+                     Eigen::Vector3d max);
+  static void addCylinder(GeneratedObject &obj, Eigen::Vector3d base,
+                          double radius, double height, int segments);
+  static void addEllipsoid(GeneratedObject &obj, Eigen::Vector3d center,
+                           Eigen::Vector3d radii, int segments);
+};
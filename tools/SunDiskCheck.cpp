@@ -0,0 +1,57 @@
+#include "ShadowCalculator.h"
+#include <boost/format.hpp>
+#include <iostream>
+
+// Checks that cells under a large opaque roof get no light and no penumbra
+// for every sun disk sampling, in particular for odd m x m grids which have a
+// stratum in the middle of the disk.
+
+int main() {
+  WavefrontObject roof;
+  roof.setObjectName("roof");
+  Eigen::Matrix3d face = Eigen::Matrix3d::Zero();
+  face.col(0) << 1, 2, 3;
+  roof.pushFace(face);
+  face.col(0) << 1, 3, 4;
+  roof.pushFace(face);
+  WavefrontGeometry scene({roof}, {{-1000, -1000, 10},
+                                   {1000, -1000, 10},
+                                   {1000, 1000, 10},
+                                   {-1000, 1000, 10}});
+
+  Site site;
+  site.latitude = 51.46;
+  site.longitude = 5.47;
+  site.timezone = 2.0;
+  Region region;
+  region.vector1 = {1.0, 0.0, 0.0};
+  region.vector2 = {0.0, 1.0, 0.0};
+  region.stepsV1 = 4;
+  region.stepsV2 = 4;
+  region.maxHeight = 0.5;
+  RunSettings settings;
+  settings.mode = Mode::specificmoment;
+  settings.date = {2020, 6, 21, 13, 0};
+
+  bool failed = false;
+  for (int m = 1; m <= 16; m += 2) {
+    settings.sunDiskSamples = m * m;
+    ShadowCalculator calculator(scene, site, region);
+    ShadowResult result = calculator.run(settings);
+    double light = result.layer(0).maxCoeff();
+    const ShadowResult &penumbra = calculator.getPenumbraFraction();
+    double partial =
+        penumbra.layerCount() > 0 ? penumbra.layer(0).maxCoeff() : 0.0;
+    if (!(light == 0.0 && partial == 0.0)) {
+      std::cout << boost::format("%d x %d disk samples: light %.3f, penumbra "
+                                 "%.3f under an opaque roof\n") %
+                       m % m % light % partial;
+      failed = true;
+    }
+  }
+  if (failed) {
+    return EXIT_FAILURE;
+  }
+  std::cout << "Occluded cells are dark for every sun disk sampling.\n";
+  return EXIT_SUCCESS;
+}